@@ -0,0 +1,122 @@
+/*
+ * This file implements a bitmap packed into machine words.
+ */
+
+#include <stdlib.h> /* For calloc. */
+
+#include "bitmap.h"
+
+unsigned int *
+bitmap_create(int nbits)
+{
+    /*
+     * calloc() leaves every word zero, so every bit starts out clear.
+     */
+    return (calloc(BITMAP_WORDS(nbits), sizeof (unsigned int)));
+}
+
+void
+bitmap_set(unsigned int *map, int bit)
+{
+    map[bit / BITMAP_WORD_BITS] |= 1u << (bit % BITMAP_WORD_BITS);
+}
+
+void
+bitmap_clear(unsigned int *map, int bit)
+{
+    map[bit / BITMAP_WORD_BITS] &= ~(1u << (bit % BITMAP_WORD_BITS));
+}
+
+int
+bitmap_test(unsigned int *map, int bit)
+{
+    return ((map[bit / BITMAP_WORD_BITS] >> (bit % BITMAP_WORD_BITS)) & 1);
+}
+
+/*
+ * Requires:
+ *  "first" <= "last", both bits of "map".
+ *
+ * Effects:
+ *  Returns the first clear bit of "map" from "first" to "last", or -1 if
+ *  they are all set.  Full words are skipped without looking at their bits.
+ */
+static int
+find_clear_in_range(unsigned int *map, int first, int last)
+{
+    int bit = first;
+
+    while (bit <= last) {
+        unsigned int word = map[bit / BITMAP_WORD_BITS];
+
+        if (word == ~0u) {
+            /*
+             * Skip to the start of the next word.
+             */
+            bit = (bit / BITMAP_WORD_BITS + 1) * BITMAP_WORD_BITS;
+            continue;
+        }
+        if (!((word >> (bit % BITMAP_WORD_BITS)) & 1))
+            return (bit);
+        bit++;
+    }
+    return (-1);
+}
+
+int
+bitmap_find_clear(unsigned int *map, int nbits, int start)
+{
+    int bit;
+
+    if (start < 0 || start >= nbits)
+        start = 0;
+    bit = find_clear_in_range(map, start, nbits - 1);
+    if (bit == -1 && start > 0)
+        bit = find_clear_in_range(map, 0, start - 1);
+    return (bit);
+}
+
+/*
+ * Requires:
+ *  "first" <= "last", both bits of "map".
+ *
+ * Effects:
+ *  Returns the first bit of the first run of "len" clear bits from "first"
+ *  that ends by "last", or -1 if there is none.
+ */
+static int
+find_run_in_range(unsigned int *map, int first, int last, int len)
+{
+    int bit = first;
+
+    while (bit <= last - len + 1) {
+        int run;
+
+        bit = find_clear_in_range(map, bit, last);
+        if (bit == -1 || bit > last - len + 1)
+            return (-1);
+        for (run = 1; run < len && !bitmap_test(map, bit + run); run++)
+            ;
+        if (run == len)
+            return (bit);
+        /*
+         * The run ended at a set bit, so no run can start before it.
+         */
+        bit += run + 1;
+    }
+    return (-1);
+}
+
+int
+bitmap_find_clear_run(unsigned int *map, int nbits, int start, int len)
+{
+    int bit;
+
+    if (start < 0 || start >= nbits)
+        start = 0;
+    bit = find_run_in_range(map, start, nbits - 1, len);
+    if (bit == -1 && start > 0)
+        bit = find_run_in_range(map, 0, start + len - 2 < nbits - 1 ?
+            start + len - 2 : nbits - 1, len);
+    return (bit);
+}
@@ -0,0 +1,65 @@
+/*
+ * This file defines the interface for a bitmap, an array of bits packed
+ * into machine words.  The file server uses bitmaps to track which blocks
+ * and inodes are in use; finding a clear bit skips a whole word at a time
+ * while the words are full.
+ */
+
+/*
+ * The number of bits in a bitmap word.
+ */
+#define	BITMAP_WORD_BITS	(8 * (int)sizeof (unsigned int))
+
+/*
+ * Requires:
+ *  "nbits" must be greater than zero.
+ *
+ * Effects:
+ *  Returns the number of words needed to hold "nbits" bits.
+ */
+#define	BITMAP_WORDS(nbits)	(((nbits) + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS)
+
+/*
+ * Requires:
+ *  "nbits" must be greater than zero.
+ *
+ * Effects:
+ *  Creates a bitmap of "nbits" bits, all of them clear.  Returns a pointer
+ *  to its words if it was successfully created and NULL if it was not.
+ */
+unsigned int *bitmap_create(int nbits);
+
+/*
+ * Requires:
+ *  "bit" is a bit of "map".
+ *
+ * Effects:
+ *  Sets, clears or tests "bit".
+ */
+void bitmap_set(unsigned int *map, int bit);
+void bitmap_clear(unsigned int *map, int bit);
+int bitmap_test(unsigned int *map, int bit);
+
+/*
+ * Requires:
+ *  "map" has "nbits" bits.
+ *
+ * Effects:
+ *  Returns the first clear bit of "map" at or after "start", wrapping
+ *  around to the beginning of "map" if there is none after it.  Returns -1
+ *  if every bit is set.
+ */
+int bitmap_find_clear(unsigned int *map, int nbits, int start);
+
+/*
+ * Requires:
+ *  "map" has "nbits" bits.
+ *  "len" must be greater than zero.
+ *
+ * Effects:
+ *  Returns the first bit of the first run of "len" clear bits of "map" that
+ *  starts at or after "start", wrapping around to the beginning of "map" if
+ *  there is none after it.  A run does not wrap around the end of "map".
+ *  Returns -1 if there is no such run.
+ */
+int bitmap_find_clear_run(unsigned int *map, int nbits, int start, int len);
@@ -0,0 +1,240 @@
+/*
+ * This file implements the directory name lookup cache.  Entries are kept
+ * in a chained hash table with about one chain per entry, and in a doubly
+ * linked list from the least to the most recently used, which picks the
+ * entry to replace once every entry is in use.
+ */
+
+#include <stdlib.h> /* For malloc, calloc and free. */
+#include <string.h> /* For memcmp, memcpy and memset. */
+
+#include <comp421/filesystem.h>
+
+#include "dcache.h"
+
+/*
+ * Requires:
+ *  Nothing.
+ *
+ * Effects:
+ *  Returns the length of the name at the start of "name".
+ */
+static int
+name_length(char *name)
+{
+    int len = 0;
+
+    while (len < DIRNAMELEN && name[len] != '\0' && name[len] != '/')
+        len++;
+    return (len);
+}
+
+/*
+ * Requires:
+ *  Nothing.
+ *
+ * Effects:
+ *  Returns the chain of the name "name" of length "len" in the directory
+ *  "parent", using the FNV-1a hash of both.
+ */
+static dcache_entry **
+chain_of(struct dcache *dc, int parent, char *name, int len)
+{
+    unsigned int h = 2166136261u;
+    int i;
+
+    h = (h ^ (unsigned int)parent) * 16777619u;
+    for (i = 0; i < len; i++)
+        h = (h ^ (unsigned char)name[i]) * 16777619u;
+    return (&dc->buckets[h % dc->nbuckets]);
+}
+
+/*
+ * Requires:
+ *  Nothing.
+ *
+ * Effects:
+ *  Returns true if "entry" is the name "name" of length "len" in the
+ *  directory "parent".
+ */
+static int
+matches(dcache_entry *entry, int parent, char *name, int len)
+{
+    return (entry->parent == parent &&
+        memcmp(entry->name, name, len) == 0 &&
+        (len == DIRNAMELEN || entry->name[len] == '\0'));
+}
+
+/*
+ * Requires:
+ *  "entry" is on the recently used list of "dc".
+ *
+ * Effects:
+ *  Takes "entry" off the recently used list.
+ */
+static void
+lru_unlink(struct dcache *dc, dcache_entry *entry)
+{
+    if (entry->lru_prev != NULL)
+        entry->lru_prev->lru_next = entry->lru_next;
+    else
+        dc->lru_first = entry->lru_next;
+    if (entry->lru_next != NULL)
+        entry->lru_next->lru_prev = entry->lru_prev;
+    else
+        dc->lru_last = entry->lru_prev;
+}
+
+/*
+ * Requires:
+ *  "entry" is not on the recently used list of "dc".
+ *
+ * Effects:
+ *  Makes "entry" the most recently used entry.
+ */
+static void
+lru_append(struct dcache *dc, dcache_entry *entry)
+{
+    entry->lru_prev = dc->lru_last;
+    entry->lru_next = NULL;
+    if (dc->lru_last != NULL)
+        dc->lru_last->lru_next = entry;
+    else
+        dc->lru_first = entry;
+    dc->lru_last = entry;
+}
+
+/*
+ * Requires:
+ *  "entry" is in use.
+ *
+ * Effects:
+ *  Takes "entry" out of its chain and the recently used list, and puts it
+ *  on the free list.
+ */
+static void
+release(struct dcache *dc, dcache_entry *entry)
+{
+    dcache_entry **link;
+
+    link = chain_of(dc, entry->parent, entry->name,
+        name_length(entry->name));
+    while (*link != entry)
+        link = &(*link)->hash_next;
+    *link = entry->hash_next;
+    lru_unlink(dc, entry);
+    entry->hash_next = dc->free;
+    dc->free = entry;
+}
+
+struct dcache *
+dcache_create(int capacity)
+{
+    struct dcache *dc;
+    int i;
+
+    dc = malloc(sizeof (struct dcache));
+    if (dc == NULL)
+        return (NULL);
+    dc->entries = calloc(capacity, sizeof (dcache_entry));
+    dc->nbuckets = capacity;
+    dc->buckets = calloc(dc->nbuckets, sizeof (dcache_entry *));
+    if (dc->entries == NULL || dc->buckets == NULL) {
+        free(dc->entries);
+        free(dc->buckets);
+        free(dc);
+        return (NULL);
+    }
+    dc->capacity = capacity;
+    dc->free = NULL;
+    for (i = capacity - 1; i >= 0; i--) {
+        dc->entries[i].hash_next = dc->free;
+        dc->free = &dc->entries[i];
+    }
+    dc->lru_first = NULL;
+    dc->lru_last = NULL;
+    dc->lookups = 0;
+    dc->hits = 0;
+    dc->misses = 0;
+    dc->evictions = 0;
+    return (dc);
+}
+
+dcache_entry *
+dcache_lookup(struct dcache *dc, int parent, char *name)
+{
+    dcache_entry *entry;
+    int len = name_length(name);
+
+    if (len == 0)
+        return (NULL);
+    dc->lookups++;
+    for (entry = *chain_of(dc, parent, name, len); entry != NULL;
+        entry = entry->hash_next) {
+        if (matches(entry, parent, name, len)) {
+            dc->hits++;
+            lru_unlink(dc, entry);
+            lru_append(dc, entry);
+            return (entry);
+        }
+    }
+    dc->misses++;
+    return (NULL);
+}
+
+void
+dcache_insert(struct dcache *dc, int parent, char *name, int inum,
+    int block, int offset)
+{
+    dcache_entry *entry;
+    dcache_entry **chain;
+    int len = name_length(name);
+
+    if (len == 0)
+        return;
+    dcache_remove(dc, parent, name);
+    if (dc->free == NULL) {
+        release(dc, dc->lru_first);
+        dc->evictions++;
+    }
+    entry = dc->free;
+    dc->free = entry->hash_next;
+
+    entry->parent = parent;
+    memset(entry->name, '\0', DIRNAMELEN);
+    memcpy(entry->name, name, len);
+    entry->inum = inum;
+    entry->block = block;
+    entry->offset = offset;
+    chain = chain_of(dc, parent, name, len);
+    entry->hash_next = *chain;
+    *chain = entry;
+    lru_append(dc, entry);
+}
+
+void
+dcache_remove(struct dcache *dc, int parent, char *name)
+{
+    dcache_entry *entry;
+    int len = name_length(name);
+
+    for (entry = *chain_of(dc, parent, name, len); entry != NULL;
+        entry = entry->hash_next) {
+        if (matches(entry, parent, name, len)) {
+            release(dc, entry);
+            return;
+        }
+    }
+}
+
+void
+dcache_remove_dir(struct dcache *dc, int parent)
+{
+    dcache_entry *entry, *next;
+
+    for (entry = dc->lru_first; entry != NULL; entry = next) {
+        next = entry->lru_next;
+        if (entry->parent == parent)
+            release(dc, entry);
+    }
+}
@@ -0,0 +1,128 @@
+/*
+ * This file defines the interface for the directory name lookup cache, or
+ * dcache, which maps a name in a directory to the inode it names and to
+ * the location of its directory entry, so that looking up the same path
+ * again does not have to scan the directories along it.  A name that was
+ * looked up and not found is cached as well, as a negative entry.
+ *
+ * Names are path components: they end at a '/', at a NUL or after
+ * DIRNAMELEN characters, whichever comes first, the same way a directory
+ * entry's name is compared with a path.  <comp421/filesystem.h> must be
+ * included first, for DIRNAMELEN.
+ */
+
+typedef struct dcache_entry dcache_entry;
+
+/*
+ * A cached name.
+ */
+struct dcache_entry {
+	/*
+	 * The inode number of the directory, and the name in it, padded with
+	 * NULs.
+	 */
+	int parent;
+	char name[DIRNAMELEN];
+	/*
+	 * The inode number the name refers to, or 0 if the name does not
+	 * exist in the directory.
+	 */
+	int inum;
+	/*
+	 * The block and the offset in it of the name's directory entry, if
+	 * "inum" is not 0.
+	 */
+	int block;
+	int offset;
+	/*
+	 * The next entry in the same collision chain, or on the free list.
+	 */
+	dcache_entry *hash_next;
+	/*
+	 * The neighbors in the list of entries from the least to the most
+	 * recently used.
+	 */
+	dcache_entry *lru_prev;
+	dcache_entry *lru_next;
+};
+
+/*
+ * A dcache:
+ *
+ *  Holds up to "capacity" entries, all allocated when it is created, in a
+ *  chained hash table.  Once it is full, caching another name replaces the
+ *  least recently used entry.
+ */
+struct dcache {
+	dcache_entry *entries;
+	int capacity;
+	dcache_entry **buckets;
+	unsigned int nbuckets;
+	/*
+	 * The entries not in use.
+	 */
+	dcache_entry *free;
+	dcache_entry *lru_first;
+	dcache_entry *lru_last;
+	/*
+	 * Counters: lookups, the lookups that found an entry (positive or
+	 * negative) and the ones that did not, and replaced entries.
+	 */
+	int lookups;
+	int hits;
+	int misses;
+	int evictions;
+};
+
+/*
+ * Requires:
+ *  "capacity" must be greater than zero.
+ *
+ * Effects:
+ *  Creates an empty dcache that holds up to "capacity" names.  Returns a
+ *  pointer to it if it was successfully created and NULL if it was not.
+ */
+struct dcache *dcache_create(int capacity);
+
+/*
+ * Requires:
+ *  Nothing.
+ *
+ * Effects:
+ *  Searches "dc" for the name "name" in the directory "parent".  If it is
+ *  cached, marks it as the most recently used entry and returns it; the
+ *  entry is only valid until the next call that changes "dc".  Otherwise,
+ *  returns NULL.
+ */
+dcache_entry *dcache_lookup(struct dcache *dc, int parent, char *name);
+
+/*
+ * Requires:
+ *  Nothing.
+ *
+ * Effects:
+ *  Caches the name "name" in the directory "parent" as referring to the
+ *  inode "inum", whose directory entry is at "offset" in "block", or as a
+ *  negative entry if "inum" is 0.  Replaces the entry for the name if
+ *  there is one.  Empty names are not cached.
+ */
+void dcache_insert(struct dcache *dc, int parent, char *name, int inum,
+    int block, int offset);
+
+/*
+ * Requires:
+ *  Nothing.
+ *
+ * Effects:
+ *  Forgets the name "name" in the directory "parent", if it is cached.
+ */
+void dcache_remove(struct dcache *dc, int parent, char *name);
+
+/*
+ * Requires:
+ *  Nothing.
+ *
+ * Effects:
+ *  Forgets every name cached in the directory "parent".
+ */
+void dcache_remove_dir(struct dcache *dc, int parent);
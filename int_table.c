@@ -0,0 +1,197 @@
+/*
+ * This file implements an integer-keyed hash table that uses open addressing
+ * with linear probing.  Mappings are stored inline in the slot array, and
+ * removals shift later members of the probe sequence back instead of leaving
+ * tombstones, so lookups never have to skip over deleted slots.
+ */
+
+#include <assert.h>
+#include <stdlib.h> /* For calloc and free. */
+
+#include "int_table.h"
+
+/*
+ * The smallest number of slots a table is created with:
+ */
+#define	MIN_SIZE	8
+
+/*
+ * Requires:
+ *  Nothing.
+ *
+ * Effects:
+ *  Returns the home slot of "key" in a table of "size" slots.  The bits of
+ *  the key are mixed first so that strided keys (such as the block numbers
+ *  of one inode table block after another) do not all land in the same
+ *  neighborhood.
+ */
+static unsigned int
+home_slot(int key, unsigned int size)
+{
+    unsigned int h = (unsigned int)key;
+
+    h ^= h >> 16;
+    h *= 0x45d9f3b;
+    h ^= h >> 16;
+    return (h & (size - 1));
+}
+
+/*
+ * Requires:
+ *  "expected" must be greater than zero.
+ *
+ * Effects:
+ *  Returns the number of slots needed to hold "expected" mappings while
+ *  staying at most three quarters full.
+ */
+static unsigned int
+size_for(int expected)
+{
+    unsigned int size = MIN_SIZE;
+
+    while (size * 3 < (unsigned int)expected * 4)
+        size *= 2;
+    return (size);
+}
+
+/*
+ * Requires:
+ *  "value" is not NULL and "slots" has an empty slot.
+ *
+ * Effects:
+ *  Stores the mapping in the first empty slot of the probe sequence of
+ *  "key".
+ */
+static void
+place(int_table_slot *slots, unsigned int size, int key, void *value)
+{
+    unsigned int index = home_slot(key, size);
+
+    while (slots[index].value != NULL)
+        index = (index + 1) & (size - 1);
+    slots[index].key = key;
+    slots[index].value = value;
+}
+
+struct int_table *
+int_table_create(int expected)
+{
+    struct int_table *t;
+
+    assert(expected > 0);
+    t = malloc(sizeof (struct int_table));
+    if (t == NULL)
+        return (NULL);
+    t->size = size_for(expected);
+    /*
+     * calloc() leaves every value NULL, so every slot starts out empty.
+     */
+    t->slots = calloc(t->size, sizeof (int_table_slot));
+    if (t->slots == NULL) {
+        free(t);
+        return (NULL);
+    }
+    t->occupancy = 0;
+    t->resizes = 0;
+    return (t);
+}
+
+void
+int_table_destroy(struct int_table *t)
+{
+    free(t->slots);
+    free(t);
+}
+
+int
+int_table_resize(struct int_table *t, int expected)
+{
+    int_table_slot *new_slots;
+    unsigned int new_size, index;
+
+    assert(expected > 0 && (unsigned int)expected >= t->occupancy);
+    new_size = size_for(expected);
+    if (new_size == t->size)
+        return (0);
+    new_slots = calloc(new_size, sizeof (int_table_slot));
+    if (new_slots == NULL)
+        return (-1);
+    for (index = 0; index < t->size; index++) {
+        if (t->slots[index].value != NULL)
+            place(new_slots, new_size, t->slots[index].key,
+                t->slots[index].value);
+    }
+    free(t->slots);
+    t->slots = new_slots;
+    t->size = new_size;
+    t->resizes++;
+    return (0);
+}
+
+int
+int_table_insert(struct int_table *t, int key, void *value)
+{
+    assert(int_table_lookup(t, key) == NULL);
+    assert(value != NULL);
+    /*
+     * Should the table grow?  The caches size their tables so that this
+     * never happens, but other users get correct behavior anyway.
+     */
+    if ((t->occupancy + 1) * 4 > t->size * 3) {
+        if (int_table_resize(t, (t->occupancy + 1) * 2) == -1)
+            return (-1);
+    }
+    place(t->slots, t->size, key, value);
+    t->occupancy++;
+    return (0);
+}
+
+void *
+int_table_lookup(struct int_table *t, int key)
+{
+    unsigned int index = home_slot(key, t->size);
+
+    /*
+     * The probe sequence of "key" ends at the first empty slot.
+     */
+    while (t->slots[index].value != NULL) {
+        if (t->slots[index].key == key)
+            return (t->slots[index].value);
+        index = (index + 1) & (t->size - 1);
+    }
+    return (NULL);
+}
+
+void *
+int_table_remove(struct int_table *t, int key)
+{
+    unsigned int mask = t->size - 1;
+    unsigned int index = home_slot(key, t->size);
+    unsigned int next, home;
+    void *value;
+
+    while (t->slots[index].value != NULL && t->slots[index].key != key)
+        index = (index + 1) & mask;
+    value = t->slots[index].value;
+    if (value == NULL)
+        return (NULL);
+    /*
+     * Shift back every later mapping in this cluster whose home slot does
+     * not lie cyclically between the hole and the mapping itself, so that
+     * no probe sequence is broken by the hole.
+     */
+    next = index;
+    for (;;) {
+        next = (next + 1) & mask;
+        if (t->slots[next].value == NULL)
+            break;
+        home = home_slot(t->slots[next].key, t->size);
+        if (((next - home) & mask) >= ((next - index) & mask)) {
+            t->slots[index] = t->slots[next];
+            index = next;
+        }
+    }
+    t->slots[index].value = NULL;
+    t->occupancy--;
+    return (value);
+}
@@ -0,0 +1,107 @@
+/*
+ * This file defines the interface for an integer-keyed hash table that uses
+ * open addressing with linear probing.  Unlike the chained hash table in
+ * hash_table.h, every mapping is stored inline in a single array of slots,
+ * so inserting and removing mappings never allocates memory and a lookup
+ * usually touches a single cache line.
+ */
+
+typedef struct int_table_slot int_table_slot;
+
+/*
+ * A slot of the table.  A slot whose "value" is NULL is empty.
+ */
+struct int_table_slot {
+	int key;
+	void *value;
+};
+
+/*
+ * An integer hash table:
+ *
+ *  Stores a collection of "key"-to-"value" mappings in an array of slots
+ *  whose length is a power of two.  The table is kept at most three quarters
+ *  full so that probe sequences stay short.
+ */
+struct int_table {
+	/*
+	 * The array of slots.
+	 */
+	int_table_slot *slots;
+	/*
+	 * The number of slots, always a power of two.
+	 */
+	unsigned int size;
+	/*
+	 * The number of mappings in the table.
+	 */
+	unsigned int occupancy;
+	/*
+	 * The number of times the slot array has been reallocated since the
+	 * table was created.
+	 */
+	unsigned int resizes;
+};
+
+/*
+ * Requires:
+ *  "expected" must be greater than zero.
+ *
+ * Effects:
+ *  Creates a table with room for "expected" mappings without ever needing
+ *  to grow.  Returns a pointer to the table if it was successfully created
+ *  and NULL if it was not.
+ */
+struct int_table *int_table_create(int expected);
+
+/*
+ * Requires:
+ *  Nothing.
+ *
+ * Effects:
+ *  Destroys a table.  The values stored in it are not touched.
+ */
+void int_table_destroy(struct int_table *t);
+
+/*
+ * Requires:
+ *  "key" is not already in "t".
+ *  "value" is not NULL.
+ *
+ * Effects:
+ *  Creates a mapping from "key" to "value" in "t", growing the table first
+ *  if it is too full.  Returns 0 if the mapping was successfully created and
+ *  -1 if it was not.
+ */
+int int_table_insert(struct int_table *t, int key, void *value);
+
+/*
+ * Requires:
+ *  Nothing.
+ *
+ * Effects:
+ *  Searches "t" for "key".  If "key" is found, returns its associated value.
+ *  Otherwise, returns NULL.
+ */
+void *int_table_lookup(struct int_table *t, int key);
+
+/*
+ * Requires:
+ *  Nothing.
+ *
+ * Effects:
+ *  Searches "t" for "key".  If "key" is found, removes its mapping and
+ *  returns the value it was mapped to.  Otherwise, returns NULL.
+ */
+void *int_table_remove(struct int_table *t, int key);
+
+/*
+ * Requires:
+ *  "expected" must be greater than zero and at least the current occupancy.
+ *
+ * Effects:
+ *  Rebuilds "t" with room for "expected" mappings.  Returns 0 if the table
+ *  was successfully rebuilt (or already had the right size) and -1 if it
+ *  was not, in which case "t" is unchanged.
+ */
+int int_table_resize(struct int_table *t, int expected);
@@ -253,6 +253,78 @@ sendStatMessage(char *pathname, struct Stat *statbuf)
     return code;
 }
 
+static int
+sendStatsMessage(struct yfs_stats *statsbuf)
+{
+    if (statsbuf == NULL) {
+        return ERROR;
+    }
+    struct message_stats * msg = malloc(sizeof(struct message_stats));
+    if (msg == NULL) {
+        TracePrintf(1, "error allocating space for stats message\n");
+        return ERROR;
+    }
+    msg->num = YFS_STATS;
+    msg->statsbuf = statsbuf;
+    if (Send(msg, -FILE_SERVER) != 0) {
+        TracePrintf(1, "error sending message to server\n");
+        free(msg);
+        return ERROR;
+    }
+    // msg gets overwritten with reply message after return from Send
+    int code = msg->num;
+    free(msg);
+    return code;
+}
+
+static int
+sendResizeMessage(int block_cache_size, int inode_cache_size)
+{
+    struct message_resize * msg = malloc(sizeof(struct message_resize));
+    if (msg == NULL) {
+        TracePrintf(1, "error allocating space for resize message\n");
+        return ERROR;
+    }
+    msg->num = YFS_RESIZE;
+    msg->block_cache_size = block_cache_size;
+    msg->inode_cache_size = inode_cache_size;
+    if (Send(msg, -FILE_SERVER) != 0) {
+        TracePrintf(1, "error sending message to server\n");
+        free(msg);
+        return ERROR;
+    }
+    // msg gets overwritten with reply message after return from Send
+    int code = msg->num;
+    free(msg);
+    return code;
+}
+
+static int
+sendFallocateMessage(int inodenum, int offset, int len)
+{
+    if (inodenum <= 0) {
+        return ERROR;
+    }
+    struct message_fallocate * msg = malloc(sizeof(struct message_fallocate));
+    if (msg == NULL) {
+        TracePrintf(1, "error allocating space for fallocate message\n");
+        return ERROR;
+    }
+    msg->num = YFS_FALLOCATE;
+    msg->inodenum = inodenum;
+    msg->offset = offset;
+    msg->len = len;
+    if (Send(msg, -FILE_SERVER) != 0) {
+        TracePrintf(1, "error sending message to server\n");
+        free(msg);
+        return ERROR;
+    }
+    // msg gets overwritten with reply message after return from Send
+    int code = msg->num;
+    free(msg);
+    return code;
+}
+
 static int
 sendGenericMessage(int operation) {
     struct message_generic * msg = malloc(sizeof(struct message_generic));
@@ -448,6 +520,50 @@ Sync()
     return code;
 }
 
+int
+Stats(struct yfs_stats *statsbuf)
+{
+    int code = sendStatsMessage(statsbuf);
+    if (code == ERROR) {
+        TracePrintf(1, "received error from server\n");
+    }
+    return code;
+}
+
+int
+ResizeCaches(int block_cache_size, int inode_cache_size)
+{
+    int code = sendResizeMessage(block_cache_size, inode_cache_size);
+    if (code == ERROR) {
+        TracePrintf(1, "received error from server\n");
+    }
+    return code;
+}
+
+int
+Fallocate(int fd, int offset, int len)
+{
+    struct open_file * file = getFile(fd);
+    if (file == NULL) {
+        return ERROR;
+    }
+    int code = sendFallocateMessage(file->inodenum, offset, len);
+    if (code == ERROR) {
+        TracePrintf(1, "received error from server\n");
+    }
+    return code;
+}
+
+int
+Compact(char *pathname)
+{
+    int code = sendPathMessage(YFS_COMPACT, pathname);
+    if (code == ERROR) {
+        TracePrintf(1, "received error from server\n");
+    }
+    return code;
+}
+
 int
 Shutdown()
 {
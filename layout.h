@@ -0,0 +1,62 @@
+/*
+ * On-disk layout shared by mkyfs and the server
+ *
+ * The fs_header in the first inode slot of block 1 has 56 bytes of padding.
+ * A disk made by our mkyfs uses them to say where its free inode and free
+ * block bitmaps are (right after the inode table, before the root
+ * directory's block) and whether the server shut down cleanly, in which case
+ * the bitmaps on disk are up to date. A disk without YFS_MAGIC or
+ * YFS_MAGIC_V1 has no bitmaps, and the server always scans its inode table.
+ *
+ * On a YFS_MAGIC disk a block pointer, in an inode's direct[] or in an
+ * indirect block, may also be negative: -n means block n is allocated to
+ * the file (by Fallocate) but has never been written, and reads as zeros
+ * whatever is on the disk. Disks marked YFS_MAGIC_V1 have bitmaps but no
+ * such pointers, so a server that predates them can still use the disk;
+ * the server preallocates blocks on them by writing zeros to the blocks.
+ */
+
+#define YFS_MAGIC 0x59465332
+#define YFS_MAGIC_V1 0x59465331
+
+// bits of a bitmap held by one block
+#define BITS_PER_BITMAP_BLOCK (BLOCKSIZE * 8)
+
+struct yfs_header {
+    int num_blocks;
+    int num_inodes;
+    int magic;
+    // nonzero if the bitmaps on disk match the inode table
+    int clean;
+    // a set bit means the inode is allocated
+    int inode_bitmap_start;
+    int inode_bitmap_blocks;
+    // a set bit means the block is in use
+    int block_bitmap_start;
+    int block_bitmap_blocks;
+    char padding[32];
+};
+
+/*
+ * A directory that grows past DIR_INDEX_THRESHOLD entries gets a hashed
+ * index, kept in an inode of its own. The directory's third entry (right
+ * after "." and "..") then marks it: its inum is 0, so programs that read
+ * the directory see a free entry, and the rest of it says which inode holds
+ * the index. The index is an open addressing hash table of unsigned shorts,
+ * each one 0 or the number of an entry of the directory, hashed by its name.
+ */
+
+#define DIR_INDEX_ENTRY 2
+#define DIR_INDEX_MAGIC "hidx"
+
+struct dir_index_marker {
+    // always 0
+    short inum;
+    // always '\0', so the entry has an empty name
+    char zero;
+    char magic[5];
+    int index_inode;
+    // index slots in use
+    int used;
+    char padding[16];
+};
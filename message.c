@@ -91,11 +91,28 @@ processRequest()
         return_value = yfsSync();
     } else if (msg_rcv.num == YFS_SHUTDOWN) {
         return_value = yfsShutdown();
+    } else if (msg_rcv.num == YFS_STATS) {
+        struct message_stats * msg = (struct message_stats *) &msg_rcv;
+        return_value = yfsStats(msg->statsbuf, pid);
+    } else if (msg_rcv.num == YFS_RESIZE) {
+        struct message_resize * msg = (struct message_resize *) &msg_rcv;
+        return_value = yfsResizeCaches(msg->block_cache_size, msg->inode_cache_size);
+    } else if (msg_rcv.num == YFS_FALLOCATE) {
+        struct message_fallocate * msg = (struct message_fallocate *) &msg_rcv;
+        return_value = yfsFallocate(msg->inodenum, msg->offset, msg->len);
+    } else if (msg_rcv.num == YFS_COMPACT) {
+        struct message_path * msg = (struct message_path *) &msg_rcv;
+        char *pathname = getPathFromProcess(pid, msg->pathname, msg->len);
+        return_value = yfsCompact(pathname, msg->current_inode);
+        free(pathname);
     } else {
         TracePrintf(1, "unknown operation %d\n", msg_rcv.num);
         return_value = ERROR;
     }
     
+    // inodes the request used in place may now be evicted
+    releaseInodePins();
+    
     // send reply
     struct message_generic msg_rply;
     msg_rply.num = return_value;
@@ -19,6 +19,47 @@
 #define YFS_STAT        12
 #define YFS_SYNC        13
 #define YFS_SHUTDOWN    14
+#define YFS_STATS       15
+#define YFS_RESIZE      16
+#define YFS_FALLOCATE   17
+#define YFS_COMPACT     18
+
+/*
+ * Counters describing how one of the server's caches has behaved since the
+ * server started
+ */
+struct yfs_cache_stats {
+    // how many items the cache may hold
+    int capacity;
+    int lookups;
+    int hits;
+    int misses;
+    int evictions;
+    // evictions that had to write the item back first
+    int dirty_evictions;
+    // evictions of clean items, which skipped the write-back
+    int clean_evictions;
+    // items written back, on eviction or by sync
+    int writebacks;
+    // items written back by sync
+    int sync_writes;
+    // blocks read ahead of a sequential reader
+    int readaheads;
+    // times the cache's hash table was resized
+    int resizes;
+};
+
+/*
+ * Server statistics, as returned by Stats()
+ */
+struct yfs_stats {
+    struct yfs_cache_stats block_cache;
+    struct yfs_cache_stats inode_cache;
+    // only capacity, lookups, hits, misses and evictions are counted
+    struct yfs_cache_stats name_cache;
+    int free_inodes;
+    int free_blocks;
+};
 
 /*
  * A generic message that can only hold 
@@ -108,4 +149,38 @@ struct message_stat {
     struct Stat *statbuf;
 };
 
+/*
+ * A message for stats
+ */
+struct message_stats {
+    int num;
+    struct yfs_stats *statsbuf;
+    char padding[24];
+};
+
+/*
+ * A message for resizing the server's caches
+ */
+struct message_resize {
+    int num;
+    int block_cache_size;
+    int inode_cache_size;
+    char padding[20];
+};
+
+/*
+ * A message for preallocating blocks of a file
+ */
+struct message_fallocate {
+    int num;
+    int inodenum;
+    int offset;
+    int len;
+    char padding[16];
+};
+
 void processRequest();
+int Stats(struct yfs_stats *statsbuf);
+int ResizeCaches(int block_cache_size, int inode_cache_size);
+int Fallocate(int fd, int offset, int len);
+int Compact(char *pathname);
@@ -10,6 +10,9 @@
  *  running "od -X DISK" or "od -c DISK" under Unix can be useful ways
  *  to get a quick look at the DISK contents.
  *
+ *  Besides the inode table and the root directory, the file system gets
+ *  a free inode bitmap and a free block bitmap, described in layout.h.
+ *
  *  Usage: mkyfs [num_inodes]
  *
  *  The default number of inodes if num_inodes is not specified is
@@ -24,6 +27,8 @@
 
 #include <comp421/filesystem.h>
 
+#include "layout.h"
+
 #define	INODES_PER_BLOCK	(BLOCKSIZE/INODESIZE)
 
 #define DISK_FILE_NAME		"DISK"
@@ -43,6 +48,9 @@ main(int argc, char **argv)
     struct inode *inodes;
     int inodes_size;
     struct dir_entry root[2];
+    struct yfs_header *hdr;
+    int inode_bitmap_blocks, block_bitmap_blocks, root_block;
+    unsigned int *bitmap;
 
     if (argc > 1) {
 	if (sscanf(argv[1], "%d", &num_inodes) != 1) {
@@ -61,16 +69,34 @@ main(int argc, char **argv)
     inodes_size = (num_inodes + 1) * INODESIZE;
     /* force rounded up to BLOCKSIZE multiple */
     inodes_size = (inodes_size + BLOCKSIZE - 1) & ~(BLOCKSIZE - 1);
-    inodes = (struct inode *)malloc(inodes_size);
+    inodes = (struct inode *)calloc(1, inodes_size);
 
-    ((struct fs_header *)inodes)->num_blocks = NUMSECTORS;
-    ((struct fs_header *)inodes)->num_inodes = num_inodes;
+    /*
+     *  The bitmaps go right after the inode table, and the root
+     *  directory's block right after them.
+     */
+    inode_bitmap_blocks =
+	(num_inodes + 1 + BITS_PER_BITMAP_BLOCK - 1) / BITS_PER_BITMAP_BLOCK;
+    block_bitmap_blocks =
+	(NUMSECTORS + BITS_PER_BITMAP_BLOCK - 1) / BITS_PER_BITMAP_BLOCK;
+    root_block = (inodes_size / BLOCKSIZE) + 1 +
+	inode_bitmap_blocks + block_bitmap_blocks;
+
+    hdr = (struct yfs_header *)inodes;
+    hdr->num_blocks = NUMSECTORS;
+    hdr->num_inodes = num_inodes;
+    hdr->magic = YFS_MAGIC;
+    hdr->clean = 1;
+    hdr->inode_bitmap_start = (inodes_size / BLOCKSIZE) + 1;
+    hdr->inode_bitmap_blocks = inode_bitmap_blocks;
+    hdr->block_bitmap_start = hdr->inode_bitmap_start + inode_bitmap_blocks;
+    hdr->block_bitmap_blocks = block_bitmap_blocks;
 
     inodes[1].type = INODE_DIRECTORY;
     inodes[1].nlink = 2;
     inodes[1].reuse = 1;
     inodes[1].size = 2 * sizeof(struct dir_entry);
-    inodes[1].direct[0] = (inodes_size / BLOCKSIZE) + 1;
+    inodes[1].direct[0] = root_block;
 
     for (i = 2; i <= num_inodes; i++) {
 	inodes[i].type = INODE_FREE;
@@ -83,6 +109,30 @@ main(int argc, char **argv)
 	exit(1);
     }
 
+    /*
+     *  Inode 0 (the header) and the root directory are allocated, and
+     *  so is every block up to and including the root directory's.
+     */
+    bitmap = (unsigned int *)calloc(inode_bitmap_blocks, BLOCKSIZE);
+    bitmap[0] = 3;
+    if (write(disk, bitmap, inode_bitmap_blocks * BLOCKSIZE) !=
+	inode_bitmap_blocks * BLOCKSIZE) {
+	perror("write inode bitmap");
+	unlink(DISK_FILE_NAME);
+	exit(1);
+    }
+    free(bitmap);
+    bitmap = (unsigned int *)calloc(block_bitmap_blocks, BLOCKSIZE);
+    for (i = 0; i <= root_block; i++)
+	bitmap[i / (8 * sizeof(int))] |= 1u << (i % (8 * sizeof(int)));
+    if (write(disk, bitmap, block_bitmap_blocks * BLOCKSIZE) !=
+	block_bitmap_blocks * BLOCKSIZE) {
+	perror("write block bitmap");
+	unlink(DISK_FILE_NAME);
+	exit(1);
+    }
+    free(bitmap);
+
     memset((void *)root, '\0', sizeof(root));
     root[0].inum = ROOTINODE;
     root[0].name[0] = '.';
@@ -0,0 +1,262 @@
+/*
+ * Replacement policies for the block cache
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <comp421/filesystem.h>
+#include <comp421/yalnix.h>
+#include "yfs.h"
+#include "int_table.h"
+#include "policy.h"
+
+/*
+ * Removes and returns the first item of the queue that is not pinned
+ */
+static cacheItem *
+removeFirstUnpinned(queue *queue) {
+    cacheItem *item = queue->firstItem;
+    while (item != NULL && item->pins > 0) {
+        item = item->nextItem;
+    }
+    if (item != NULL) {
+        removeItemFromQueue(queue, item);
+    }
+    return item;
+}
+
+/*
+ * LRU: a single queue with the least recently used item at the front
+ */
+
+static void *
+lruCreate(int capacity) {
+    (void)capacity;
+    queue *lru = malloc(sizeof(queue));
+    if (lru == NULL) {
+        return NULL;
+    }
+    lru->firstItem = NULL;
+    lru->lastItem = NULL;
+    return lru;
+}
+
+static void
+lruInsert(void *state, cacheItem *item) {
+    addItemToEndOfQueue(item, (queue *)state);
+}
+
+static void
+lruHit(void *state, cacheItem *item) {
+    removeItemFromQueue((queue *)state, item);
+    addItemToEndOfQueue(item, (queue *)state);
+}
+
+static cacheItem *
+lruEvict(void *state) {
+    return removeFirstUnpinned((queue *)state);
+}
+
+static void
+lruRemove(void *state, cacheItem *item) {
+    removeItemFromQueue((queue *)state, item);
+}
+
+static void
+lruResize(void *state, int capacity) {
+    (void)state;
+    (void)capacity;
+}
+
+cachePolicy lruPolicy = {"lru", lruCreate, lruInsert, lruHit, lruEvict,
+    lruRemove, lruResize};
+
+/*
+ * 2Q (Johnson and Shasha): a block seen for the first time goes into the
+ * FIFO probation queue A1in. When it falls out of A1in only its number is
+ * remembered, in the ghost queue A1out. A block that is missed again while
+ * its number is still in A1out has proven to be reused, so it goes into the
+ * LRU queue Am. A long sequential scan therefore only cycles through A1in
+ * and cannot push the hot blocks out of Am.
+ */
+
+#define LIST_A1IN 0
+#define LIST_AM 1
+
+struct twoQueueState {
+    queue a1in;
+    queue am;
+    int a1inSize;
+    // A1in may hold up to a quarter of the cache before it gives up items
+    int a1inMax;
+    // A1out: a ring of remembered block numbers, and a table from block
+    // number to its slot in the ring
+    int *ghosts;
+    int ghostMax;
+    int ghostCount;
+    int ghostHead;
+    struct int_table *ghostTable;
+};
+
+static void *
+twoQueueCreate(int capacity) {
+    struct twoQueueState *tq = malloc(sizeof(struct twoQueueState));
+    if (tq == NULL) {
+        return NULL;
+    }
+    memset(tq, 0, sizeof(struct twoQueueState));
+    tq->a1inMax = capacity / 4 > 0 ? capacity / 4 : 1;
+    tq->ghostMax = capacity / 2 > 0 ? capacity / 2 : 1;
+    tq->ghosts = malloc(tq->ghostMax * sizeof(int));
+    tq->ghostTable = int_table_create(tq->ghostMax);
+    if (tq->ghosts == NULL || tq->ghostTable == NULL) {
+        free(tq->ghosts);
+        free(tq);
+        return NULL;
+    }
+    return tq;
+}
+
+static void
+rememberGhost(struct twoQueueState *tq, int blockNum) {
+    if (int_table_lookup(tq->ghostTable, blockNum) != NULL) {
+        return;
+    }
+    // forget the oldest ghost if A1out is full
+    int slot = (tq->ghostHead + tq->ghostCount) % tq->ghostMax;
+    if (tq->ghostCount == tq->ghostMax) {
+        int oldest = tq->ghosts[tq->ghostHead];
+        if (int_table_lookup(tq->ghostTable, oldest) == &tq->ghosts[tq->ghostHead]) {
+            int_table_remove(tq->ghostTable, oldest);
+        }
+        tq->ghostHead = (tq->ghostHead + 1) % tq->ghostMax;
+    } else {
+        tq->ghostCount++;
+    }
+    tq->ghosts[slot] = blockNum;
+    int_table_insert(tq->ghostTable, blockNum, &tq->ghosts[slot]);
+}
+
+static void
+twoQueueInsert(void *state, cacheItem *item) {
+    struct twoQueueState *tq = state;
+    if (int_table_remove(tq->ghostTable, item->number) != NULL) {
+        item->list = LIST_AM;
+        addItemToEndOfQueue(item, &tq->am);
+    } else {
+        item->list = LIST_A1IN;
+        addItemToEndOfQueue(item, &tq->a1in);
+        tq->a1inSize++;
+    }
+}
+
+static void
+twoQueueHit(void *state, cacheItem *item) {
+    struct twoQueueState *tq = state;
+    // A1in is a FIFO, a hit there does not move the block
+    if (item->list == LIST_AM) {
+        removeItemFromQueue(&tq->am, item);
+        addItemToEndOfQueue(item, &tq->am);
+    }
+}
+
+static cacheItem *
+twoQueueEvictFromA1in(struct twoQueueState *tq) {
+    cacheItem *item = removeFirstUnpinned(&tq->a1in);
+    if (item != NULL) {
+        tq->a1inSize--;
+        rememberGhost(tq, item->number);
+    }
+    return item;
+}
+
+static cacheItem *
+twoQueueEvict(void *state) {
+    struct twoQueueState *tq = state;
+    cacheItem *item = NULL;
+    if (tq->a1inSize > tq->a1inMax || tq->am.firstItem == NULL) {
+        item = twoQueueEvictFromA1in(tq);
+    }
+    if (item == NULL) {
+        item = removeFirstUnpinned(&tq->am);
+    }
+    if (item == NULL) {
+        item = twoQueueEvictFromA1in(tq);
+    }
+    return item;
+}
+
+static void
+twoQueueRemove(void *state, cacheItem *item) {
+    struct twoQueueState *tq = state;
+    if (item->list == LIST_AM) {
+        removeItemFromQueue(&tq->am, item);
+    } else {
+        removeItemFromQueue(&tq->a1in, item);
+        tq->a1inSize--;
+    }
+}
+
+static void
+twoQueueResize(void *state, int capacity) {
+    struct twoQueueState *tq = state;
+    tq->a1inMax = capacity / 4 > 0 ? capacity / 4 : 1;
+    
+    // rebuild A1out with the new capacity, keeping the newest ghosts
+    int ghostMax = capacity / 2 > 0 ? capacity / 2 : 1;
+    int *ghosts = malloc(ghostMax * sizeof(int));
+    struct int_table *ghostTable = int_table_create(ghostMax);
+    if (ghosts == NULL || ghostTable == NULL) {
+        // keep the old ghosts, which are still correct, only less or more
+        // of them than wanted
+        free(ghosts);
+        if (ghostTable != NULL) {
+            int_table_destroy(ghostTable);
+        }
+        return;
+    }
+    // walk the ring from the newest ghost back, skipping slots whose block
+    // has been forgotten or remembered again in a newer slot
+    int kept = 0;
+    int i;
+    for (i = tq->ghostCount - 1; i >= 0 && kept < ghostMax; i--) {
+        int *slot = &tq->ghosts[(tq->ghostHead + i) % tq->ghostMax];
+        if (int_table_lookup(tq->ghostTable, *slot) == slot) {
+            kept++;
+        }
+    }
+    int next = kept;
+    for (i = tq->ghostCount - 1; i >= 0 && next > 0; i--) {
+        int *slot = &tq->ghosts[(tq->ghostHead + i) % tq->ghostMax];
+        if (int_table_lookup(tq->ghostTable, *slot) == slot) {
+            next--;
+            ghosts[next] = *slot;
+            int_table_insert(ghostTable, ghosts[next], &ghosts[next]);
+        }
+    }
+    free(tq->ghosts);
+    int_table_destroy(tq->ghostTable);
+    tq->ghosts = ghosts;
+    tq->ghostTable = ghostTable;
+    tq->ghostMax = ghostMax;
+    tq->ghostCount = kept;
+    tq->ghostHead = 0;
+}
+
+cachePolicy twoQueuePolicy = {"2q", twoQueueCreate, twoQueueInsert, twoQueueHit, twoQueueEvict,
+    twoQueueRemove, twoQueueResize};
+
+static cachePolicy *policies[] = {&lruPolicy, &twoQueuePolicy};
+
+/*
+ * Returns the policy with the given name, or NULL if there is none
+ */
+cachePolicy *
+findCachePolicy(char *name) {
+    unsigned int i;
+    for (i = 0; i < sizeof(policies) / sizeof(policies[0]); i++) {
+        if (strcmp(policies[i]->name, name) == 0) {
+            return policies[i];
+        }
+    }
+    return NULL;
+}
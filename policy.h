@@ -0,0 +1,32 @@
+/*
+ * Replacement policies for the block cache
+ *
+ * getBlock() decides on hits and misses and owns the frames; a policy only
+ * orders the cached items and picks which one to evict. Each policy keeps
+ * its own state, created once per cache by create().
+ */
+
+typedef struct cachePolicy cachePolicy;
+
+struct cachePolicy {
+    // name used to select the policy on the server command line
+    char *name;
+    // returns the policy state for a cache holding up to capacity items
+    void *(*create)(int capacity);
+    // item was just brought into the cache
+    void (*insert)(void *state, cacheItem *item);
+    // item was referenced while in the cache
+    void (*hit)(void *state, cacheItem *item);
+    // removes the item to evict from the policy's lists and returns it,
+    // never choosing a pinned item; returns NULL if every item is pinned
+    cacheItem *(*evict)(void *state);
+    // removes a cached item that is being dropped from the cache
+    void (*remove)(void *state, cacheItem *item);
+    // the cache now holds up to capacity items
+    void (*resize)(void *state, int capacity);
+};
+
+extern cachePolicy lruPolicy;
+extern cachePolicy twoQueuePolicy;
+
+cachePolicy *findCachePolicy(char *name);
@@ -0,0 +1,43 @@
+#include <stdio.h>
+
+#include <comp421/yalnix.h>
+#include <comp421/iolib.h>
+
+int
+main()
+{
+	int status;
+	int fd;
+	int i;
+	char name[32];
+	struct Stat sb;
+
+	/* enough entries for the directory to get an index */
+	MkDir("/big");
+	for (i = 0; i < 80; i++) {
+		sprintf(name, "/big/f%d", i);
+		fd = Create(name);
+		Close(fd);
+	}
+
+	/* "." and ".." are found in it, also when looked up again */
+	for (i = 0; i < 2; i++) {
+		status = Stat("/big/..", &sb);
+		printf("Stat /big/.. status %d inum %d\n", status, sb.inum);
+		status = Stat("/big/.", &sb);
+		printf("Stat /big/. status %d inum %d\n", status, sb.inum);
+		fd = Open("/big/../big/f42");
+		printf("Open /big/../big/f42 status %d\n", fd);
+		Close(fd);
+	}
+
+	status = ChDir("/big");
+	printf("ChDir /big status %d\n", status);
+	status = ChDir("..");
+	printf("ChDir .. status %d\n", status);
+	status = Stat("big", &sb);
+	printf("Stat big status %d size %d\n", status, sb.size);
+
+	Shutdown();
+	return (0);
+}
@@ -0,0 +1,68 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <comp421/yalnix.h>
+#include <comp421/iolib.h>
+
+#include "message.h"
+
+int
+main()
+{
+	int status;
+	int fd;
+	int i;
+	char name[32];
+	struct Stat sb;
+	struct yfs_stats before, after;
+
+	MkDir("/cdir");
+	for (i = 0; i < 48; i++) {
+		sprintf(name, "/cdir/f%d", i);
+		fd = Create(name);
+		Close(fd);
+	}
+
+	/* freeing half the entries is not enough to compact on its own */
+	for (i = 0; i < 48; i += 2) {
+		sprintf(name, "/cdir/f%d", i);
+		Unlink(name);
+	}
+	Stat("/cdir", &sb);
+	printf("after unlinking half, size %d\n", sb.size);
+
+	Stats(&before);
+	status = Compact("/cdir");
+	Stats(&after);
+	Stat("/cdir", &sb);
+	printf("Compact status %d, size %d, freed %d blocks\n", status,
+	    sb.size, after.free_blocks - before.free_blocks);
+
+	/* the remaining names are still found where they moved to */
+	fd = Open("/cdir/f47");
+	printf("Open f47 %s\n", fd >= 0 ? "ok" : "failed");
+	Close(fd);
+	fd = Open("/cdir/f46");
+	printf("Open f46 %s\n", fd >= 0 ? "found" : "not found");
+
+	/* a directory that is mostly free is compacted by itself */
+	for (i = 100; i < 140; i++) {
+		sprintf(name, "/cdir/f%d", i);
+		fd = Create(name);
+		Close(fd);
+	}
+	Stat("/cdir", &sb);
+	printf("after 40 more, size %d\n", sb.size);
+	for (i = 100; i < 140; i++) {
+		sprintf(name, "/cdir/f%d", i);
+		Unlink(name);
+	}
+	Stat("/cdir", &sb);
+	printf("after unlinking them, size %d\n", sb.size);
+
+	status = Compact("/cdir/f1");
+	printf("Compact(file) status %d\n", status);
+
+	Shutdown();
+	return (0);
+}
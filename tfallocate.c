@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <comp421/yalnix.h>
+#include <comp421/iolib.h>
+
+#include "message.h"
+
+int
+main()
+{
+	int status;
+	int fd;
+	int i;
+	int zeros;
+	static char buffer[1024];
+	struct yfs_stats before, after;
+
+	fd = Create("/log");
+	Stats(&before);
+
+	/* reserve room for the whole log up front */
+	status = Fallocate(fd, 0, 8192);
+	Stats(&after);
+	printf("Fallocate status %d, took %d blocks\n", status,
+	    before.free_blocks - after.free_blocks);
+
+	/* unwritten blocks read as zeros */
+	status = Read(fd, buffer, sizeof(buffer));
+	zeros = 0;
+	for (i = 0; i < status; i++)
+		if (buffer[i] == '\0')
+			zeros++;
+	printf("Read status %d, %d zeros\n", status, zeros);
+
+	/* writing them allocates nothing more */
+	Seek(fd, 0, SEEK_SET);
+	memset(buffer, 'l', 100);
+	for (i = 0; i < 40; i++)
+		Write(fd, buffer, 100);
+	Stats(&before);
+	printf("wrote 4000 bytes, took %d more blocks\n",
+	    after.free_blocks - before.free_blocks);
+
+	Seek(fd, 3990, SEEK_SET);
+	status = Read(fd, buffer, 20);
+	printf("Read status %d: '%c' ... %d\n", status, buffer[0], buffer[19]);
+
+	status = Fallocate(fd, -1, 10);
+	printf("Fallocate(-1, 10) status %d\n", status);
+
+	Close(fd);
+	Shutdown();
+	return (0);
+}
@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <comp421/yalnix.h>
+#include <comp421/iolib.h>
+
+#include "message.h"
+
+static void
+print_sizes(void)
+{
+	struct yfs_stats stats;
+	int status;
+
+	status = Stats(&stats);
+	printf("Stats status %d: block cache %d blocks, inode cache %d inodes\n",
+	    status, stats.block_cache.capacity, stats.inode_cache.capacity);
+}
+
+int
+main()
+{
+	int status;
+	int fd;
+	int i;
+	char name[16];
+	static char buffer[1024];
+
+	print_sizes();
+
+	status = ResizeCaches(64, 0);
+	printf("ResizeCaches(64, 0) status %d\n", status);
+	print_sizes();
+
+	memset(buffer, 'r', sizeof(buffer));
+	for (i = 0; i < 20; i++) {
+		sprintf(name, "/r%d", i);
+		fd = Create(name);
+		Write(fd, buffer, sizeof(buffer));
+		Close(fd);
+	}
+
+	/* shrinking writes back the dirty blocks it evicts */
+	status = ResizeCaches(32, 2);
+	printf("ResizeCaches(32, 2) status %d\n", status);
+	print_sizes();
+
+	for (i = 0; i < 20; i++) {
+		sprintf(name, "/r%d", i);
+		fd = Open(name);
+		status = Read(fd, buffer, sizeof(buffer));
+		printf("%s: read %d bytes, first '%c'\n", name, status, buffer[0]);
+		Close(fd);
+	}
+
+	status = ResizeCaches(48, 0);
+	printf("ResizeCaches(48, 0) status %d\n", status);
+	print_sizes();
+
+	status = ResizeCaches(8, 0);
+	printf("ResizeCaches(8, 0) status %d\n", status);
+
+	Shutdown();
+	return (0);
+}
@@ -0,0 +1,34 @@
+#include <stdio.h>
+
+#include <comp421/yalnix.h>
+#include <comp421/iolib.h>
+
+int
+main()
+{
+	int status;
+
+	/* neither names an entry that could be removed */
+	status = RmDir("/");
+	printf("RmDir / status %d\n", status);
+	status = RmDir("");
+	printf("RmDir \"\" status %d\n", status);
+
+	MkDir("/d");
+	status = RmDir("/d/.");
+	printf("RmDir /d/. status %d\n", status);
+	status = RmDir("/d/..");
+	printf("RmDir /d/.. status %d\n", status);
+
+	Create("/f");
+	status = RmDir("/f");
+	printf("RmDir /f status %d\n", status);
+
+	status = RmDir("/d");
+	printf("RmDir /d status %d\n", status);
+	status = RmDir("/d");
+	printf("RmDir /d again status %d\n", status);
+
+	Shutdown();
+	return (0);
+}
@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <comp421/yalnix.h>
+#include <comp421/iolib.h>
+
+#include "message.h"
+
+static void
+print_cache(char *name, struct yfs_cache_stats *c)
+{
+	printf("%s: %d lookups, %d hits, %d misses\n",
+	    name, c->lookups, c->hits, c->misses);
+	printf("%s: %d evictions (%d dirty, %d clean), %d writebacks "
+	    "(%d by sync), %d readaheads, %d resizes\n",
+	    name, c->evictions, c->dirty_evictions, c->clean_evictions,
+	    c->writebacks, c->sync_writes, c->readaheads, c->resizes);
+}
+
+int
+main()
+{
+	int status;
+	int fd;
+	int i;
+	static char buffer[1024];
+	struct yfs_stats before, after;
+
+	status = Stats(&before);
+	printf("Stats status %d\n", status);
+	print_cache("block cache", &before.block_cache);
+	print_cache("inode cache", &before.inode_cache);
+	print_cache("name cache", &before.name_cache);
+	printf("free inodes %d, free blocks %d\n",
+	    before.free_inodes, before.free_blocks);
+
+	fd = Create("/stats");
+	printf("Create fd %d\n", fd);
+	memset(buffer, 'x', sizeof(buffer));
+	for (i = 0; i < 8; i++)
+		Write(fd, buffer, sizeof(buffer));
+	Seek(fd, 0, SEEK_SET);
+	for (i = 0; i < 8; i++)
+		Read(fd, buffer, sizeof(buffer));
+	Close(fd);
+	Sync();
+
+	status = Stats(&after);
+	printf("Stats status %d\n", status);
+	print_cache("block cache", &after.block_cache);
+	print_cache("inode cache", &after.inode_cache);
+	print_cache("name cache", &after.name_cache);
+	printf("free inodes %d, free blocks %d\n",
+	    after.free_inodes, after.free_blocks);
+	printf("block lookups during test: %d (%d hits)\n",
+	    after.block_cache.lookups - before.block_cache.lookups,
+	    after.block_cache.hits - before.block_cache.hits);
+
+	status = Stats(NULL);
+	printf("Stats(NULL) status %d\n", status);
+
+	Shutdown();
+	return (0);
+}
@@ -0,0 +1,30 @@
+#include <stdio.h>
+
+#include <comp421/yalnix.h>
+#include <comp421/iolib.h>
+
+int
+main()
+{
+	int status;
+
+	/* directories are removed with RmDir, never with Unlink */
+	MkDir("/d");
+	status = Unlink("/d");
+	printf("Unlink /d status %d\n", status);
+	status = Unlink("/d/.");
+	printf("Unlink /d/. status %d\n", status);
+	status = Unlink("/d/..");
+	printf("Unlink /d/.. status %d\n", status);
+	status = Unlink("/");
+	printf("Unlink / status %d\n", status);
+
+	Create("/d/f");
+	status = Unlink("/d/f");
+	printf("Unlink /d/f status %d\n", status);
+	status = RmDir("/d");
+	printf("RmDir /d status %d\n", status);
+
+	Shutdown();
+	return (0);
+}
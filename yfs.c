@@ -3,30 +3,174 @@
 #include <stdlib.h>
 #include <string.h>
 #include "yfs.h"
-#include "hash_table.h"
+#include "int_table.h"
 #include "message.h"
+#include "policy.h"
+#include "bitmap.h"
+#include "dcache.h"
+#include "layout.h"
 #include <comp421/iolib.h>
 
 
-#define LOADFACTOR 1.5
-
-freeInode *firstFreeInode = NULL;
-freeBlock *firstFreeBlock = NULL;
+// one bit per block of the disk, set if the block is in use
+unsigned int *blockBitmap = NULL;
+int numBlocks = 0;
+// every block before this one is in use
+int firstFreeBlockHint = 0;
+// one bit per inode, set if the inode is allocated, and how many inodes
+// of each inode table block are free
+unsigned int *inodeBitmap = NULL;
+int numInodes = 0;
+int *freeInodesPerBlock = NULL;
+int numInodeTableBlocks = 0;
+// the header of the disk; if it has YFS_MAGIC, the bitmaps are stored on
+// disk as well and bitmapsDirty is set when they need to be written back
+struct yfs_header diskHeader;
+bool bitmapsOnDisk = false;
+// whether block pointers may be negated to mark unwritten blocks
+bool unwrittenOnDisk = false;
+bool bitmapsDirty = false;
+// per inode, where to look for a free block for the first block of the
+// file: the parent directory's entry block, or the old first block of a
+// truncated file
+int *blockGoals = NULL;
+// a growing file that cannot continue right after its last block skips
+// holes smaller than this
+#define MIN_FREE_RUN 8
 
 int freeInodeCount = 0;
 int freeBlockCount = 0;
-int currentInode = ROOTINODE;
 
-int numSymLinks = 0;
+// when set, yfsWrite() does not allocate blocks: a new block of a file only
+// exists in the cache, pinned, under a delayed block number past the end of
+// the disk, until flushDelayedBlocks() allocates blocks for all of them.
+// Each delayed block holds a reservation on a free block (two if the file
+// will also need its indirect block), so that the flush cannot run out.
+bool delayedAllocation = false;
+int numDelayedBlocks = 0;
+int reservedBlockCount = 0;
+// per inode, whether a block is reserved for its indirect block
+bool *indirectReserved = NULL;
+int currentInode = ROOTINODE;
 
 queue *cacheInodeQueue;
-struct hash_table *inodeTable;
+struct int_table *inodeTable;
 int inodeCacheSize = 0;
 
-queue *cacheBlockQueue;
-struct hash_table *blockTable;
+struct int_table *blockTable;
 int blockCacheSize = 0;
+struct cachePartition partitions[NUM_PARTITIONS] = {
+    {"data", 0, 0, NULL},
+    {"metadata", 0, 0, NULL}
+};
+
+struct yfs_cache_stats blockCacheStats;
+struct yfs_cache_stats inodeCacheStats;
+// names looked up in directories, and names known not to be in them
+struct dcache *nameCache = NULL;
+
+// readahead state, one slot per inode number modulo READAHEAD_SLOTS
+#define READAHEAD_SLOTS 16
+#define MIN_READAHEAD 2
+#define MAX_READAHEAD 16
+struct readahead readaheads[READAHEAD_SLOTS];
+
+// free entry summaries, one slot per directory inode number modulo
+// FREE_SLOT_DIRS
+#define FREE_SLOT_DIRS 16
+struct dirFreeSlots dirFreeSlots[FREE_SLOT_DIRS];
+
+// the replacement policy of the block cache, chosen on the command line;
+// each partition keeps its own state for it
+cachePolicy *blockPolicy = &lruPolicy;
+
+// how many blocks and inodes the caches may hold, set with -b and -i and
+// changed at run time by yfsResizeCaches()
+int blockCacheCapacity = BLOCK_CACHESIZE;
+int inodeCacheCapacity = INODE_CACHESIZE;
+
+// the slabs of block frames, newest first, and the frames not holding any
+// block; frames beyond the capacity after the cache shrank are kept spare
+frameChunk *frameChunks = NULL;
+int numBlockFrames = 0;
+cacheItem *freeBlockFrames = NULL;
+cacheItem *spareBlockFrames = NULL;
+
+// when set, getInode() returns inodes in place in their inode table blocks
+// instead of keeping copies of them in the inode cache
+bool unifiedInodeCache = false;
+// the frames pinned by getInode() in unified mode, least recently used
+// first
+cacheItem *inodePinnedFrames[MAX_INODE_PINS];
+int numInodePinnedFrames = 0;
+
+// scratch list used by yfsSync() to sort the dirty blocks
+cacheItem **dirtyBlocks;
+
+// what a hole, or a preallocated block that has not been written yet, reads
+// as
+char zeroBlock[BLOCKSIZE];
+
+
+/*
+ * Splits the block cache capacity between the partitions. Metadata gets
+ * half of it, so streaming file data through the other half cannot evict
+ * the blocks that path lookups need.
+ */
+static void
+setPartitionBudgets(void) {
+    partitions[METADATA_PARTITION].budget = blockCacheCapacity / 2;
+    partitions[DATA_PARTITION].budget = blockCacheCapacity - blockCacheCapacity / 2;
+}
 
+/*
+ * Makes the arrays that hold a pointer per block frame big enough for
+ * count frames
+ */
+static int
+resizeFrameArrays(int count) {
+    cacheItem **newDirtyBlocks = realloc(dirtyBlocks, count * sizeof(cacheItem *));
+    if (newDirtyBlocks == NULL) {
+        return ERROR;
+    }
+    dirtyBlocks = newDirtyBlocks;
+    return 0;
+}
+
+/*
+ * Allocates a slab of count block frames and puts them on the free list
+ */
+static int
+addFrameChunk(int count) {
+    if (resizeFrameArrays(numBlockFrames + count) == ERROR) {
+        return ERROR;
+    }
+    frameChunk *chunk = malloc(sizeof(frameChunk));
+    if (chunk == NULL) {
+        return ERROR;
+    }
+    chunk->frames = malloc(count * sizeof(blockFrame));
+    if (chunk->frames == NULL) {
+        free(chunk);
+        return ERROR;
+    }
+    chunk->count = count;
+    int i;
+    for (i = count - 1; i >= 0; i--) {
+        cacheItem *item = &chunk->frames[i].item;
+        item->addr = chunk->frames[i].data;
+        item->number = 0;
+        item->dirty = false;
+        item->pins = 0;
+        item->inodePins = 0;
+        item->nextItem = freeBlockFrames;
+        freeBlockFrames = item;
+    }
+    chunk->next = frameChunks;
+    frameChunks = chunk;
+    numBlockFrames += count;
+    return 0;
+}
 
 void 
 init() {
@@ -34,11 +178,35 @@ init() {
     cacheInodeQueue->firstItem = NULL;
     cacheInodeQueue->lastItem = NULL;
     
-    cacheBlockQueue = malloc(sizeof(queue));
-    cacheBlockQueue->firstItem = NULL;
-    cacheBlockQueue->lastItem = NULL;
-    inodeTable = hash_table_create(LOADFACTOR, INODE_CACHESIZE + 1);
-    blockTable = hash_table_create(LOADFACTOR, BLOCK_CACHESIZE + 1);
+    inodeTable = int_table_create(inodeCacheCapacity);
+    blockTable = int_table_create(blockCacheCapacity);
+    nameCache = dcache_create(NAME_CACHESIZE);
+    TracePrintf(1, "block cache: %d blocks, inode cache: %d inodes\n",
+        blockCacheCapacity, inodeCacheCapacity);
+    TracePrintf(1, "block cache replacement policy: %s\n", blockPolicy->name);
+    if (unifiedInodeCache) {
+        TracePrintf(1, "serving inodes in place from the block cache\n");
+    }
+    if (delayedAllocation) {
+        TracePrintf(1, "allocating file blocks when they are flushed\n");
+    }
+    
+    setPartitionBudgets();
+    int i;
+    for (i = 0; i < NUM_PARTITIONS; i++) {
+        partitions[i].policyState = blockPolicy->create(partitions[i].budget);
+        if (partitions[i].policyState == NULL) {
+            TracePrintf(1, "error allocating the block cache\n");
+            Exit(1);
+        }
+    }
+    
+    // allocate every block frame up front and put them all on the free list
+    if (inodeTable == NULL || blockTable == NULL || nameCache == NULL
+            || addFrameChunk(blockCacheCapacity) == ERROR) {
+        TracePrintf(1, "error allocating the block cache\n");
+        Exit(1);
+    }
     buildFreeInodeAndBlockLists();
     
     if (Register(FILE_SERVER) != 0) {
@@ -99,7 +267,6 @@ addItemToEndOfQueue(cacheItem *item, queue *queue)
 {
     // if the queue is empty
     if (queue->firstItem == NULL) {
-        if (queue == cacheBlockQueue)
         item->nextItem = NULL;
         item->prevItem = NULL;
         queue->lastItem = item;
@@ -132,108 +299,416 @@ saveBlock(int blockNumber) {
     // mark the block as dirty
     //void *block = getBlock(blockNumber);
     //(void)block;
-    cacheItem *blockItem = (cacheItem *)hash_table_lookup(blockTable, blockNumber);
+    cacheItem *blockItem = (cacheItem *)int_table_lookup(blockTable, blockNumber);
     blockItem->dirty = true;
 }
 
+/*
+ * Evicts the block in the frame, writing it back first only if it is dirty
+ */
+void
+evictFrame(cacheItem *item) {
+    blockCacheStats.evictions++;
+    if (item->dirty) {
+        WriteSector(item->number, item->addr);
+        blockCacheStats.dirty_evictions++;
+        blockCacheStats.writebacks++;
+    } else {
+        blockCacheStats.clean_evictions++;
+    }
+    int_table_remove(blockTable, item->number);
+}
+
+/*
+ * Returns true if the frame holds a cached block
+ */
+static bool
+frameInUse(cacheItem *item) {
+    return int_table_lookup(blockTable, item->number) == item;
+}
+
+/*
+ * Evicts the block in the frame and puts the frame on the free list
+ */
+static void
+dropFrame(cacheItem *item) {
+    blockPolicy->remove(partitions[item->partition].policyState, item);
+    partitions[item->partition].size--;
+    evictFrame(item);
+    blockCacheSize--;
+    item->nextItem = freeBlockFrames;
+    freeBlockFrames = item;
+}
+
+/*
+ * Evicts a block of another partition than the given one, only of one that
+ * has borrowed beyond its budget if overBudgetOnly is set, and moves its
+ * frame to the given partition. Returns the frame, or NULL if there is no
+ * block to evict.
+ */
+static cacheItem *
+takeOtherPartitionFrame(int partitionNum, bool overBudgetOnly) {
+    int i;
+    for (i = 0; i < NUM_PARTITIONS; i++) {
+        if (i == partitionNum 
+                || (overBudgetOnly && partitions[i].size <= partitions[i].budget)) {
+            continue;
+        }
+        cacheItem *item = blockPolicy->evict(partitions[i].policyState);
+        if (item != NULL) {
+            partitions[i].size--;
+            partitions[partitionNum].size++;
+            return item;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Returns a frame for a new block of the given partition, or NULL if there
+ * is none because every block that could be evicted is pinned.
+ * 
+ * If the partition is full, the replacement policy picks one of its blocks
+ * to evict, and the evicted frame is reused. Otherwise a free frame is
+ * used, or if another partition has borrowed the free frames, a frame is
+ * taken back from it. If the partition is full but all its blocks are
+ * pinned, it borrows a frame beyond its budget: a free one if there is one
+ * left, or else one taken from another partition, preferably one that has
+ * borrowed itself.
+ */
+cacheItem *
+reclaimFrame(int partitionNum) {
+    struct cachePartition *partition = &partitions[partitionNum];
+    cacheItem *item = NULL;
+    bool underBudget = partition->size < partition->budget;
+    if (underBudget && freeBlockFrames == NULL) {
+        item = takeOtherPartitionFrame(partitionNum, true);
+    }
+    if (item == NULL && (!underBudget || freeBlockFrames == NULL)) {
+        item = blockPolicy->evict(partition->policyState);
+    }
+    if (item == NULL && freeBlockFrames == NULL) {
+        item = takeOtherPartitionFrame(partitionNum, true);
+    }
+    if (item == NULL && freeBlockFrames == NULL) {
+        item = takeOtherPartitionFrame(partitionNum, false);
+    }
+    if (item != NULL) {
+        evictFrame(item);
+        return item;
+    }
+    if (freeBlockFrames == NULL) {
+        return NULL;
+    }
+    item = freeBlockFrames;
+    freeBlockFrames = item->nextItem;
+    blockCacheSize++;
+    partition->size++;
+    return item;
+}
+
+/*
+ * Returns the cached copy of the block, reading it into the given partition
+ * of the cache if it is not cached yet. A block that is already cached stays
+ * in the partition it was read into.
+ */
 void *
-getBlock(int blockNumber) {
+getBlockInPartition(int blockNumber, int partitionNum) {
     //TracePrintf(1, "GETTING BLOCK #%d\n", blockNumber);
     // First check to see if Block is in the cache using hashmap
-    // If it is, remove it from the middle of the block queue add it to the front
+    // If it is, tell the replacement policy it was used again
     // return the pointer to it
-    cacheItem *blockItem = (cacheItem *)hash_table_lookup(blockTable, blockNumber);
+    cacheItem *blockItem = (cacheItem *)int_table_lookup(blockTable, blockNumber);
     
+    blockCacheStats.lookups++;
     if (blockItem != NULL) {
-        removeItemFromQueue(cacheBlockQueue, blockItem);
-        addItemToEndOfQueue(blockItem, cacheBlockQueue);
+        blockCacheStats.hits++;
+        blockPolicy->hit(partitions[blockItem->partition].policyState, blockItem);
         return blockItem->addr;
     }
     
     // If the block is not in the cache
+    blockCacheStats.misses++;
     
-    // If the cache is full, remove the LRU block from the end of the queue, 
-    // and get the block number
-    // Use the block number to remove it from the hashmap
-    if (blockCacheSize == BLOCK_CACHESIZE) {
-        cacheItem *lruBlockItem = removeItemFromFrontOfQueue(cacheBlockQueue);
-        int lruBlockNum = lruBlockItem->number;
-        WriteSector(lruBlockNum, lruBlockItem->addr);
-        blockCacheSize--;
-        hash_table_remove(blockTable, lruBlockNum, NULL, NULL);
-        destroyCacheItem(lruBlockItem);
+    // Get a frame for it, evicting a block if needed
+    cacheItem *newItem = reclaimFrame(partitionNum);
+    if (newItem == NULL) {
+        TracePrintf(1, "ERROR: every block in the %s cache is pinned\n", 
+            partitions[partitionNum].name);
+        return NULL;
     }
     
-    // allocate space for the new block, read it from disk 
-    // Add the new block to the front of the LRU queue and add it to the hashmap
+    // read the new block from disk into the frame
+    // Hand the new block to the replacement policy and add it to the hashmap
     // and then return the pointer to the new block
     //TracePrintf(1, "block was NOT in cache\n");
-    void *block = malloc(BLOCKSIZE);
-    ReadSector(blockNumber, block);
-    cacheItem *newItem = malloc(sizeof(cacheItem));
+    ReadSector(blockNumber, newItem->addr);
     newItem->number = blockNumber;
-    newItem->addr = block;
     newItem->dirty = false;
+    newItem->partition = partitionNum;
     
-    addItemToEndOfQueue(newItem, cacheBlockQueue);
-    blockCacheSize++;
-    hash_table_insert(blockTable, blockNumber, newItem);
-    return block;
+    blockPolicy->insert(partitions[partitionNum].policyState, newItem);
+    int_table_insert(blockTable, blockNumber, newItem);
+    return newItem->addr;
+}
+
+void *
+getBlock(int blockNumber) {
+    return getBlockInPartition(blockNumber, DATA_PARTITION);
+}
+
+void *
+getMetadataBlock(int blockNumber) {
+    return getBlockInPartition(blockNumber, METADATA_PARTITION);
+}
+
+/*
+ * Returns the cached block zeroed and marked dirty, for a block whose old
+ * contents do not matter: one that was just allocated, or one the caller
+ * is about to overwrite completely. If the block is not cached, a frame is
+ * set up for it in the given partition without reading it from the disk.
+ */
+static void *
+getZeroedBlockInPartition(int blockNumber, int partitionNum) {
+    cacheItem *blockItem = (cacheItem *)int_table_lookup(blockTable, blockNumber);
+    
+    blockCacheStats.lookups++;
+    if (blockItem != NULL) {
+        blockCacheStats.hits++;
+        blockPolicy->hit(partitions[blockItem->partition].policyState, blockItem);
+    } else {
+        blockCacheStats.misses++;
+        blockItem = reclaimFrame(partitionNum);
+        if (blockItem == NULL) {
+            TracePrintf(1, "ERROR: every block in the %s cache is pinned\n", 
+                partitions[partitionNum].name);
+            return NULL;
+        }
+        blockItem->number = blockNumber;
+        blockItem->partition = partitionNum;
+        blockPolicy->insert(partitions[partitionNum].policyState, blockItem);
+        int_table_insert(blockTable, blockNumber, blockItem);
+    }
+    memset(blockItem->addr, 0, BLOCKSIZE);
+    blockItem->dirty = true;
+    return blockItem->addr;
+}
+
+void *
+getBlockForOverwrite(int blockNumber) {
+    return getZeroedBlockInPartition(blockNumber, DATA_PARTITION);
+}
+
+void *
+getMetadataBlockForOverwrite(int blockNumber) {
+    return getZeroedBlockInPartition(blockNumber, METADATA_PARTITION);
+}
+
+/*
+ * Pins a cached block, so that it is not evicted (and pointers into it stay
+ * valid) until it is unpinned. Pins are counted, so a block pinned twice
+ * must be unpinned twice.
+ */
+void
+pinBlock(int blockNumber) {
+    cacheItem *blockItem = (cacheItem *)int_table_lookup(blockTable, blockNumber);
+    blockItem->pins++;
+}
+
+void
+unpinBlock(int blockNumber) {
+    cacheItem *blockItem = (cacheItem *)int_table_lookup(blockTable, blockNumber);
+    blockItem->pins--;
+}
+
+/*
+ * Reads a data block into the cache if it is not there already, without
+ * counting it as a use of the block; it only counts as a readahead, not as
+ * a lookup and a miss
+ */
+void
+prefetchBlock(int blockNumber) {
+    if (int_table_lookup(blockTable, blockNumber) == NULL) {
+        getBlockInPartition(blockNumber, DATA_PARTITION);
+        blockCacheStats.lookups--;
+        blockCacheStats.misses--;
+        blockCacheStats.readaheads++;
+    }
 }
 
 void
 saveInode(int inodeNum) {
 //    struct inode *inode = getInode(inodeNum);
 //    (void)inode;
+    // In unified mode the inode lives in its block, so mark that dirty
+    if (unifiedInodeCache) {
+        saveBlock((inodeNum / INODESPERBLOCK) + 1);
+        return;
+    }
     // Lookup the inode ptr in the hashmap
-    cacheItem *inodeItem = (cacheItem *)hash_table_lookup(inodeTable, inodeNum);
+    cacheItem *inodeItem = (cacheItem *)int_table_lookup(inodeTable, inodeNum);
     
     // mark the inode as dirty 
     inodeItem->dirty = true;
 }
 
+/*
+ * Copies a cached inode into its inode table block and marks the block
+ * dirty. Returns ERROR if the block cannot be read.
+ */
+int
+foldInodeIntoBlock(int inodeNum, struct inode *inode) {
+    int blockNum = (inodeNum / INODESPERBLOCK) + 1;
+    void *block = getMetadataBlock(blockNum);
+    if (block == NULL) {
+        return ERROR;
+    }
+    void *inodeAddrInBlock = (block + (inodeNum - (blockNum - 1) * INODESPERBLOCK) * INODESIZE);
+    
+    memcpy(inodeAddrInBlock, inode, sizeof(struct inode));
+    saveBlock(blockNum);
+    return 0;
+}
+
+/*
+ * Takes the inode pins off the nth frame pinned by getInodeInPlace()
+ */
+static void
+releaseInodePin(int n) {
+    cacheItem *item = inodePinnedFrames[n];
+    item->pins -= item->inodePins;
+    item->inodePins = 0;
+    numInodePinnedFrames--;
+    memmove(&inodePinnedFrames[n], &inodePinnedFrames[n + 1], 
+        (numInodePinnedFrames - n) * sizeof(cacheItem *));
+}
+
+/*
+ * Unified mode getInode(): returns a pointer to the inode inside its cached
+ * inode table block. The block is pinned so the pointer stays valid, but
+ * only the MAX_INODE_PINS most recently used blocks are kept pinned, so an
+ * inode pointer must not be kept across getInode() calls for other inodes,
+ * just as in the inode cache.
+ */
+struct inode*
+getInodeInPlace(int inodeNum) {
+    int blockNum = (inodeNum / INODESPERBLOCK) + 1;
+    cacheItem *blockItem = (cacheItem *)int_table_lookup(blockTable, blockNum);
+    inodeCacheStats.lookups++;
+    if (blockItem != NULL) {
+        inodeCacheStats.hits++;
+    } else {
+        inodeCacheStats.misses++;
+    }
+    // a block that is not pinned yet takes the place of the one pinned
+    // longest ago
+    if ((blockItem == NULL || blockItem->inodePins == 0)
+            && numInodePinnedFrames == MAX_INODE_PINS) {
+        releaseInodePin(0);
+    }
+    void *block = getMetadataBlock(blockNum);
+    if (block == NULL) {
+        return NULL;
+    }
+    blockItem = (cacheItem *)int_table_lookup(blockTable, blockNum);
+    if (blockItem->inodePins != 0) {
+        int i;
+        for (i = 0; inodePinnedFrames[i] != blockItem; i++) {
+        }
+        memmove(&inodePinnedFrames[i], &inodePinnedFrames[i + 1], 
+            (numInodePinnedFrames - i - 1) * sizeof(cacheItem *));
+        numInodePinnedFrames--;
+    }
+    inodePinnedFrames[numInodePinnedFrames++] = blockItem;
+    blockItem->inodePins++;
+    blockItem->pins++;
+    return (struct inode *)(block + (inodeNum - (blockNum - 1) * INODESPERBLOCK) * INODESIZE);
+}
+
+/*
+ * Unpins the inode table blocks pinned by getInodeInPlace(), at the end of
+ * each request. No inode pointer may be used after this.
+ */
+void
+releaseInodePins(void) {
+    while (numInodePinnedFrames > 0) {
+        releaseInodePin(0);
+    }
+}
+
+/*
+ * Evicts the least recently used inode from the inode cache, folding it
+ * into its block first if it is dirty. Returns ERROR, keeping the inode
+ * cached, if it cannot be folded.
+ */
+static int
+evictInode(void) {
+    // Get the lru inode in the cache, remove it from the hashmap
+    // get the block number corresponding to lru inode
+    // get the block corresponding to this block number
+    // get the correct address corresponding to this inode within that block
+    // copy the contents of the lru inode into this address
+    // call save block on that block
+    // (a clean inode is identical to its copy in the block, so skip that)
+    cacheItem *lruInode = cacheInodeQueue->firstItem;
+    int lruInodeNum = lruInode->number;
+    if (lruInode->dirty && foldInodeIntoBlock(lruInodeNum, lruInode->addr) == ERROR) {
+        return ERROR;
+    }
+    removeItemFromFrontOfQueue(cacheInodeQueue);
+    inodeCacheSize--;
+    int_table_remove(inodeTable, lruInodeNum);
+    inodeCacheStats.evictions++;
+    if (lruInode->dirty) {
+        inodeCacheStats.dirty_evictions++;
+        inodeCacheStats.writebacks++;
+    } else {
+        inodeCacheStats.clean_evictions++;
+    }
+    
+    destroyCacheItem(lruInode);
+    return 0;
+}
+
+/*
+ * Returns a pointer to the inode, or NULL if its inode table block cannot
+ * be read because every block frame is pinned
+ */
 struct inode*
 getInode(int inodeNum) {
+    if (unifiedInodeCache) {
+        return getInodeInPlace(inodeNum);
+    }
     // First, check to see if inode is in the cache using hashmap
     // If it is, remove it from the middle of the inode queue and add it to the front
     // return the pointer to the inode
-    cacheItem *nodeItem = (cacheItem *)hash_table_lookup(inodeTable, inodeNum);
+    cacheItem *nodeItem = (cacheItem *)int_table_lookup(inodeTable, inodeNum);
+    inodeCacheStats.lookups++;
     if (nodeItem != NULL) {
+        inodeCacheStats.hits++;
         removeItemFromQueue(cacheInodeQueue, nodeItem);
         addItemToEndOfQueue(nodeItem, cacheInodeQueue);
         return nodeItem->addr;
     }
     
     // If it is not in the cache
+    inodeCacheStats.misses++;
     
-    // If the cache is full:
-    // Get the lru inode in the cache, remove it from the hashmap
-    // get the block number corresponding to lru inode
-    // get the block corresponding to this block number
-    // get the correct address corresponding to this inode within that block
-    // copy the contents of the lru inode into this address
-    // call save block on that block
-    if (inodeCacheSize == INODE_CACHESIZE) {
-        cacheItem *lruInode = removeItemFromFrontOfQueue(cacheInodeQueue);
-        int lruInodeNum = lruInode->number;
-        inodeCacheSize--;
-        hash_table_remove(inodeTable, lruInodeNum, NULL, NULL);
-        int lruBlockNum = (lruInodeNum / INODESPERBLOCK) + 1;
-        
-        void *lruBlock = getBlock(lruBlockNum);
-        void *inodeAddrInBlock = (lruBlock + (lruInodeNum - (lruBlockNum - 1) * INODESPERBLOCK) * INODESIZE);
-        
-        memcpy(inodeAddrInBlock, lruInode->addr, sizeof(struct inode));
-        saveBlock(lruBlockNum);
-        
-        destroyCacheItem(lruInode);
+    // If the cache is full, evict the lru inode
+    // (with every block frame pinned neither that nor reading the new
+    // inode's block may be possible)
+    if (inodeCacheSize >= inodeCacheCapacity && evictInode() == ERROR) {
+        return NULL;
     }
     
     // Get the block number corresponding to this new inode
     int blockNum = (inodeNum / INODESPERBLOCK) + 1;
     
     // Get the block address for this inode
-    void *blockAddr = getBlock(blockNum);
+    void *blockAddr = getMetadataBlock(blockNum);
+    if (blockAddr == NULL) {
+        return NULL;
+    }
     
     // Look up the inodes address within the block
     struct inode *newInodeAddrInBlock = (struct inode *)(blockAddr + (inodeNum - (blockNum - 1) * INODESPERBLOCK) * INODESIZE);
@@ -244,11 +719,12 @@ getInode(int inodeNum) {
     memcpy(inodeCpy, newInodeAddrInBlock, sizeof(struct inode));
     inodeItem->addr = inodeCpy;
     inodeItem->number = inodeNum;
+    inodeItem->dirty = false;
     
     // Add this inode to the front of the LRU queue and add it to the hashmap
     addItemToEndOfQueue(inodeItem, cacheInodeQueue);
     inodeCacheSize++;
-    hash_table_insert(inodeTable, inodeNum, inodeItem);
+    int_table_insert(inodeTable, inodeNum, inodeItem);
     
     // return the address of the new inode
     return inodeItem->addr;
@@ -260,295 +736,1778 @@ destroyCacheItem(cacheItem *item) {
     free(item);
 }
 
-void *
-getBlockForInode(int inodeNumber) {
-    int blockNumber = (inodeNumber / INODESPERBLOCK) + 1;
-    return getBlock(blockNumber);
+static void
+printOneCacheStats(char *name, struct yfs_cache_stats *stats) {
+    TracePrintf(1, "%s cache: %d lookups, %d hits, %d misses, %d resizes\n",
+        name, stats->lookups, stats->hits, stats->misses, stats->resizes);
+    TracePrintf(1, "%s cache: %d evictions (%d dirty, %d clean), %d written back (%d by sync), %d read ahead\n",
+        name, stats->evictions, stats->dirty_evictions, stats->clean_evictions,
+        stats->writebacks, stats->sync_writes, stats->readaheads);
+}
+
+void
+printCacheStats(void) {
+    blockCacheStats.resizes = blockTable->resizes;
+    inodeCacheStats.resizes = inodeTable->resizes;
+    printOneCacheStats("block", &blockCacheStats);
+    printOneCacheStats("inode", &inodeCacheStats);
+    TracePrintf(1, "name cache: %d lookups, %d hits, %d misses, %d evictions\n",
+        nameCache->lookups, nameCache->hits, nameCache->misses,
+        nameCache->evictions);
 }
 
+static int getMappedBlock(struct inode *inode, int inodeNum, int n, bool allocateIfNeeded);
+
 /*
- * Expects: inode, n
- * Results: mallocs that block into memory
+ * Returns the block to start looking for a free block at when block n of
+ * the inode is allocated: the one after block n - 1, so that files stay
+ * contiguous, or for the first block the goal set when the file was
+ * created. After a hole the goal leaves room for the hole, so that if it is
+ * filled in later the file can still be contiguous.
  */
-int
-getNthBlock(struct inode *inode, int n, bool allocateIfNeeded) {
-    bool isOver = false;
-    if (n >= NUM_DIRECT + BLOCKSIZE / (int)sizeof(int)) {
-        return 0;
-    }
-    if (n*BLOCKSIZE >= inode->size) 
-    {
-        isOver = true;
-    }
-    if (isOver && !allocateIfNeeded) {
-        return 0;
-    }
-    if (n < NUM_DIRECT) {
-        if (isOver) {
-            inode->direct[n] = getNextFreeBlockNum();
+static int
+getBlockGoal(struct inode *inode, int inodeNum, int n) {
+    int m;
+    for (m = n - 1; m >= 0; m--) {
+        int blockNum = getMappedBlock(inode, inodeNum, m, false);
+        if (blockNum != 0) {
+            return abs(blockNum) + n - m;
         }
-        // if getNextFreeBlockNum returned 0, return 0
-        return inode->direct[n];
-    } 
-    //search the direct blocks
-    int *indirectBlock = getBlock(inode->indirect);
-    if (isOver) {
-        // if getNextFreeBlockNum returned 0, return 0
-        indirectBlock[n - NUM_DIRECT] = getNextFreeBlockNum();
     }
-    int blockNum = indirectBlock[n - NUM_DIRECT];
-    return blockNum;
+    return blockGoals[inodeNum] + n;
 }
 
-/**
- * 
- * @param path the file path to get the inode number for
- * @param inodeStartNumber the inode to start looking for the next part
- *       of the file path in
- * @return the inode number of the path, or 0 if it's an invalid path
+/*
+ * Returns the block number block n of the file is mapped to by its inode,
+ * allocating it if needed as described for getNthBlock()
  */
-int
-getInodeNumberForPath(char *path, int inodeStartNumber)
-{
-//    int lastSlashIndex = 0;
-//    int i = 0;
-//    while ((path[i] != '\0') && (i < MAXPATHNAMELEN)) {
-//        if (path[i] == '/') {
-//            lastSlashIndex = i;
-//        }
-//        i++;
-//    }
-//    if (lastSlashIndex == 0) {
-//        return inodeStartNumber;
-//    }
-    
-    //get the inode number for the first file in path 
-    // ex: if path is "/a/b/c.txt" get the indoe # for "a"
-    int nextInodeNumber = 0;
-
-    //Get inode corresponding to inodeStartNumber
-    void *block = getBlockForInode(inodeStartNumber);
-    struct inode *inode = getInode(inodeStartNumber);
-    if (inode->type == INODE_DIRECTORY) {
-        // go get the directory entry in this directory
-        // that has that name
-        int blockNum;
-        int offset = getDirectoryEntry(path, inodeStartNumber, &blockNum, false);
-        if (offset != -1) {
-            block = getBlock(blockNum);
-            struct dir_entry * dir_entry = (struct dir_entry *) ((char *) block + offset);
-            nextInodeNumber = dir_entry->inum;
-        }
-    } else if (inode->type == INODE_REGULAR) {
-        return 0;
-    } else if (inode->type == INODE_SYMLINK) {
+static int
+getMappedBlock(struct inode *inode, int inodeNum, int n, bool allocateIfNeeded) {
+    if (n >= MAX_FILE_BLOCKS) {
         return 0;
     }
-    char *nextPath = path;
-    if (nextInodeNumber == 0) {
-        // Return error
+    if (n*BLOCKSIZE >= inode->size && !allocateIfNeeded) {
         return 0;
     }
-    while (nextPath[0] != '/') {
-        // base case
-        if (nextPath[0] == '\0') {
-            inode = getInode(nextInodeNumber);
-            //TracePrintf(1, "are we a symlink?\n");
-            if (inode->type != INODE_SYMLINK) {
-                return nextInodeNumber;
-            }
-            else {
-                nextPath = path;
-                break;
-            }
+    if (n < NUM_DIRECT) {
+        if (inode->direct[n] == 0 && allocateIfNeeded) {
+            // a new file fills the first hole near its directory, and a
+            // growing one looks for room to stay contiguous; if there is
+            // no free block this returns 0
+            int goal = getBlockGoal(inode, inodeNum, n);
+            inode->direct[n] = n == 0 ? allocateBlockNear(goal) : allocateNextBlock(goal);
         }
-        nextPath += sizeof (char);
-    }
-    while (nextPath[0] == '/') {
-        nextPath += sizeof (char);
-    }
-    if (nextPath[0] == '\0') {
-        return nextInodeNumber;
-    }
-    //nextPath += sizeof (char);
-    inode = getInode(nextInodeNumber);
-    if (inode->type == INODE_SYMLINK) {
-        numSymLinks++;
-        if (numSymLinks > MAXSYMLINKS) {
+        return inode->direct[n];
+    } 
+    //search the indirect block, allocating it first if needed
+    if (inode->indirect == 0) {
+        if (!allocateIfNeeded) {
             return 0;
         }
-        int dataBlockNum = inode->direct[0];
-        char *dataBlock = (char *)getBlock(dataBlockNum);
-        if (dataBlock[0] == '/') {
-            dataBlock += sizeof(char);
-            inodeStartNumber = ROOTINODE;
+        inode->indirect = allocateNextBlock(getBlockGoal(inode, inodeNum, NUM_DIRECT));
+        if (inode->indirect == 0) {
+            return 0;
         }
-        nextInodeNumber = getInodeNumberForPath(dataBlock, inodeStartNumber);
-        while (nextPath[0] != '/') {
-            if (nextPath[0] == '\0') {
-                return nextInodeNumber;
-            }
-            nextPath += sizeof (char);
+        // an indirect block that cannot be zeroed would map stale numbers
+        if (getMetadataBlockForOverwrite(inode->indirect) == NULL) {
+            markBlockFree(inode->indirect);
+            inode->indirect = 0;
+            return 0;
         }
-        while (nextPath[0] == '/')
-            nextPath += sizeof(char);        
     }
-    return getInodeNumberForPath(nextPath, nextInodeNumber);
+    int *indirectBlock = getMetadataBlock(inode->indirect);
+    if (indirectBlock == NULL) {
+        return 0;
+    }
+    if (indirectBlock[n - NUM_DIRECT] == 0 && allocateIfNeeded) {
+        // the first block mapped by the indirect block goes right after it
+        int goal = n == NUM_DIRECT ? inode->indirect + 1
+            : getBlockGoal(inode, inodeNum, n);
+        // finding the goal only reads this same indirect block, and
+        // allocating only touches the bitmap, so indirectBlock stays valid
+        indirectBlock[n - NUM_DIRECT] = allocateNextBlock(goal);
+        saveBlock(inode->indirect);
+    }
+    int blockNum = indirectBlock[n - NUM_DIRECT];
+    return blockNum;
 }
 
-
 /*
- * Set inode to free and add it to the list
+ * Returns the number a delayed block n of the inode is cached under
  */
-void
-freeUpInode(int inodeNum) {
-    // get address of this inode 
-    struct inode *inode = getInode(inodeNum);
-    
-    // modify the type of inode to free
-    inode->type = INODE_FREE;
-
-    addFreeInodeToList(inodeNum);
-
-    saveInode(inodeNum);
+static int
+delayedBlockNum(int inodeNum, int n) {
+    return numBlocks + inodeNum * MAX_FILE_BLOCKS + n;
 }
 
-int
-getNextFreeInodeNum() {
-    if (firstFreeInode == NULL) {
+/*
+ * Returns the delayed block number of block n of the inode if it has been
+ * written but not allocated yet, or 0
+ */
+static int
+findDelayedBlock(int inodeNum, int n) {
+    if (numDelayedBlocks == 0 || n >= MAX_FILE_BLOCKS) {
         return 0;
     }
-//    freeInode *curr = firstFreeInode;
-//    TracePrintf(1, "------------------\n");
-//    while(curr != NULL) {
-//        TracePrintf(1, "%d\n", curr->inodeNumber);
-//        curr = curr->next;
-//    }
-//    TracePrintf(1, "------------------\n");
-    int inodeNum = firstFreeInode->inodeNumber;
-    struct inode *inode = getInode(inodeNum);
-    inode->reuse++;
-    saveInode(inodeNum);
-    firstFreeInode = firstFreeInode->next;
-//    curr = firstFreeInode;
-//    TracePrintf(1, "------------------\n");
-//    while(curr != NULL) {
-//        TracePrintf(1, "%d\n", curr->inodeNumber);
-//        curr = curr->next;
-//    }
-//    TracePrintf(1, "------------------\n");
-    return inodeNum;
-}
-
-void
-addFreeInodeToList(int inodeNum) {
-    freeInode *newHead = malloc(sizeof(freeInode));
-    newHead->inodeNumber = inodeNum;
-    newHead->next = firstFreeInode;
-    firstFreeInode = newHead;
-    freeInodeCount++;
-}
-
-int getNextFreeBlockNum() {
-    if (firstFreeBlock == NULL) {
+    int blockNum = delayedBlockNum(inodeNum, n);
+    if (int_table_lookup(blockTable, blockNum) == NULL) {
         return 0;
     }
-    int blockNum = firstFreeBlock->blockNumber;
-    firstFreeBlock = firstFreeBlock->next;
     return blockNum;
 }
 
-void
-addFreeBlockToList(int blockNum) {
-    freeBlock *newHead = malloc(sizeof(freeBlock));
-    newHead->blockNumber = blockNum;
-    newHead->next = firstFreeBlock;
-    firstFreeBlock = newHead;
-    freeBlockCount++;
+/*
+ * Expects: inode, its number, n
+ * Results: the block number of block n of the file, or 0 if there is none.
+ *     If allocateIfNeeded is set, a missing block is allocated (near the
+ *     goal given by getBlockGoal()), and so is the indirect block if it is
+ *     needed; the caller must save the inode. Otherwise a block that was
+ *     written in delayed allocation mode and not flushed yet is returned as
+ *     its delayed block number, which is only valid in the cache.
+ *     A block preallocated by yfsFallocate() and not written since is
+ *     returned negated: it is allocated, but reads as zeros.
+ */
+int
+getNthBlock(struct inode *inode, int inodeNum, int n, bool allocateIfNeeded) {
+    int blockNum = getMappedBlock(inode, inodeNum, n, allocateIfNeeded);
+    if (blockNum == 0 && !allocateIfNeeded) {
+        return findDelayedBlock(inodeNum, n);
+    }
+    return blockNum;
 }
 
-void
-buildFreeInodeAndBlockLists() {
+/*
+ * Maps block n of the file, whose indirect block must exist if n needs it,
+ * to blockNum; the caller must save the inode. Returns ERROR if the
+ * indirect block cannot be read.
+ */
+static int
+setNthBlock(struct inode *inode, int n, int blockNum) {
+    if (n < NUM_DIRECT) {
+        inode->direct[n] = blockNum;
+        return 0;
+    }
+    int *indirectBlock = getMetadataBlock(inode->indirect);
+    if (indirectBlock == NULL) {
+        return ERROR;
+    }
+    indirectBlock[n - NUM_DIRECT] = blockNum;
+    saveBlock(inode->indirect);
+    return 0;
+}
+
+/*
+ * Gives back the block reserved for the inode's indirect block, if one was
+ * reserved
+ */
+static void
+releaseIndirectReservation(int inodeNum) {
+    if (indirectReserved[inodeNum]) {
+        indirectReserved[inodeNum] = false;
+        reservedBlockCount--;
+    }
+}
+
+/*
+ * Returns how many delayed blocks may be cached before they are flushed,
+ * so that they never take up more than half of the data partition
+ */
+static int
+maxDelayedBlocks(void) {
+    int max = partitions[DATA_PARTITION].budget / 2;
+    return max > 0 ? max : 1;
+}
+
+/*
+ * Creates a zeroed, pinned cache block for block n of the inode, reserving
+ * a free block for it, and returns its delayed block number, or 0 if the
+ * disk or the cache is full
+ */
+static int
+createDelayedBlock(struct inode *inode, int inodeNum, int n) {
+    // the first delayed block the indirect block will map reserves it too
+    bool needIndirect = n >= NUM_DIRECT && inode->indirect == 0 
+        && !indirectReserved[inodeNum];
+    int cost = needIndirect ? 2 : 1;
+    if (n >= MAX_FILE_BLOCKS || freeBlockCount - reservedBlockCount < cost) {
+        return 0;
+    }
+    cacheItem *item = reclaimFrame(DATA_PARTITION);
+    if (item == NULL) {
+        return 0;
+    }
+    int blockNum = delayedBlockNum(inodeNum, n);
+    memset(item->addr, 0, BLOCKSIZE);
+    item->number = blockNum;
+    item->dirty = true;
+    item->partition = DATA_PARTITION;
+    item->pins = 1;
+    item->inodePins = 0;
+    blockPolicy->insert(partitions[DATA_PARTITION].policyState, item);
+    int_table_insert(blockTable, blockNum, item);
+    numDelayedBlocks++;
+    reservedBlockCount += cost;
+    indirectReserved[inodeNum] = indirectReserved[inodeNum] || needIndirect;
+    return blockNum;
+}
+
+/*
+ * Throws away a delayed block of a file that is being truncated
+ */
+static void
+discardDelayedBlock(int blockNum) {
+    cacheItem *item = (cacheItem *)int_table_lookup(blockTable, blockNum);
+    reservedBlockCount--;
+    numDelayedBlocks--;
+    item->pins--;
+    item->dirty = false;
+    dropFrame(item);
+}
+
+static int
+compareBlockNumbers(const void *a, const void *b) {
+    return (*(cacheItem **)a)->number - (*(cacheItem **)b)->number;
+}
+
+/*
+ * Allocates blocks for all delayed blocks, and moves each one in the cache
+ * to its block number, still dirty. They are allocated one file at a time,
+ * in file order, so each file's new blocks end up in one contiguous run
+ * even if the writes to several files were interleaved.
+ */
+void
+flushDelayedBlocks(void) {
+    if (numDelayedBlocks == 0) {
+        return;
+    }
+    // the delayed blocks sort by inode number, then by block of the file
+    int count = 0;
+    int i;
+    frameChunk *chunk;
+    for (chunk = frameChunks; chunk != NULL; chunk = chunk->next) {
+        for (i = 0; i < chunk->count; i++) {
+            cacheItem *item = &chunk->frames[i].item;
+            if (item->number >= numBlocks && frameInUse(item)) {
+                dirtyBlocks[count++] = item;
+            }
+        }
+    }
+    qsort(dirtyBlocks, count, sizeof(cacheItem *), compareBlockNumbers);
+    
+    int flushed = 0;
+    for (i = 0; i < count; i++) {
+        cacheItem *item = dirtyBlocks[i];
+        int inodeNum = (item->number - numBlocks) / MAX_FILE_BLOCKS;
+        int n = (item->number - numBlocks) % MAX_FILE_BLOCKS;
+        struct inode *inode = getInode(inodeNum);
+        
+        // a new file starts at the first hole after its directory entry
+        // that the whole run fits in, if there is one
+        if (n == 0) {
+            int runLength = 1;
+            while (i + runLength < count 
+                    && dirtyBlocks[i + runLength]->number == item->number + runLength) {
+                runLength++;
+            }
+            int runStart = bitmap_find_clear_run(blockBitmap, numBlocks, 
+                blockGoals[inodeNum], runLength);
+            if (runStart != -1) {
+                blockGoals[inodeNum] = runStart;
+            }
+        }
+        // hand the reservations back just before allocating
+        bool indirect = n >= NUM_DIRECT && indirectReserved[inodeNum];
+        reservedBlockCount--;
+        if (indirect) {
+            releaseIndirectReservation(inodeNum);
+        }
+        int blockNum = getMappedBlock(inode, inodeNum, n, true);
+        if (blockNum == 0) {
+            reservedBlockCount++;
+            if (indirect && inode->indirect == 0) {
+                indirectReserved[inodeNum] = true;
+                reservedBlockCount++;
+            }
+            TracePrintf(1, "ERROR: no block for delayed block %d of inode %d\n",
+                n, inodeNum);
+            continue;
+        }
+        saveInode(inodeNum);
+        
+        // a stale copy of the block, from before it was last freed, must
+        // not be written over the new data
+        cacheItem *stale = (cacheItem *)int_table_lookup(blockTable, blockNum);
+        if (stale != NULL) {
+            stale->dirty = false;
+            dropFrame(stale);
+        }
+        int_table_remove(blockTable, item->number);
+        item->number = blockNum;
+        int_table_insert(blockTable, blockNum, item);
+        item->pins--;
+        numDelayedBlocks--;
+        flushed++;
+    }
+    TracePrintf(1, "allocated %d delayed blocks\n", flushed);
+}
+
+/*
+ * A symlink target being walked by lookupPath(), and where to go on once
+ * it is resolved
+ */
+struct pathFrame {
+    // what is left of the path the symlink was found in
+    char *rest;
+    bool inLink;
+};
+
+/*
+ * Resolves pathname, relative to the directory currentInode unless it
+ * starts with '/', one component at a time and without copying it.
+ * Symlinks along the way are followed, and so is one named by the last
+ * component if followLast is set, at most MAXSYMLINKS of them in all.
+ * 
+ * Returns the inode number the path names, or 0 if there is none. Fills in
+ * lookup with the directory holding the path's last component (0 if that
+ * directory does not exist, or the path has no last component, like "/"),
+ * the component's name, and, if the directory has an entry by that name,
+ * its inode number (before following it if it is a symlink) and where the
+ * entry is.
+ */
+int
+lookupPath(char *pathname, int currentInode, bool followLast, struct pathLookup *lookup) {
+    lookup->dirInodeNum = 0;
+    lookup->name = NULL;
+    lookup->inodeNum = 0;
+    lookup->blockNum = 0;
+    lookup->offset = -1;
+    if (memchr(pathname, '\0', MAXPATHNAMELEN) == NULL) {
+        return 0;
+    }
+    
+    // symlink targets are walked in place, so their blocks stay pinned
+    // until the walk is done
+    struct pathFrame frames[MAXSYMLINKS + 1];
+    int pinned[MAXSYMLINKS + 1];
+    int numFrames = 0;
+    int numPinned = 0;
+    bool inLink = false;
+    
+    char *path = pathname;
+    int inodeNum = currentInode;
+    if (path[0] == '/') {
+        inodeNum = ROOTINODE;
+    }
+    while (path[0] == '/') {
+        path++;
+    }
+    while (path[0] != '\0') {
+        // the component ends at the next '/', and the rest of the path
+        // starts after the slashes following it
+        char *rest = path;
+        while (rest[0] != '/' && rest[0] != '\0') {
+            rest++;
+        }
+        while (rest[0] == '/') {
+            rest++;
+        }
+        bool lastInPath = rest[0] == '\0';
+        
+        int dirInodeNum = inodeNum;
+        int blockNum = 0;
+        int offset = -1;
+        inodeNum = 0;
+        struct inode *dir = getInode(dirInodeNum);
+        if (dir == NULL) {
+            break;
+        }
+        if (dir->type == INODE_DIRECTORY) {
+            offset = getDirectoryEntry(path, dirInodeNum, &blockNum, false);
+            char *block = offset != -1 ? getMetadataBlock(blockNum) : NULL;
+            if (block != NULL) {
+                struct dir_entry *entry = (struct dir_entry *)(block + offset);
+                inodeNum = entry->inum;
+            }
+        } else {
+            dirInodeNum = 0;
+        }
+        if (lastInPath && !inLink) {
+            lookup->dirInodeNum = dirInodeNum;
+            lookup->name = path;
+            lookup->inodeNum = inodeNum;
+            lookup->blockNum = inodeNum != 0 ? blockNum : 0;
+            lookup->offset = inodeNum != 0 ? offset : -1;
+        }
+        if (inodeNum == 0) {
+            break;
+        }
+        
+        struct inode *inode = getInode(inodeNum);
+        if (inode == NULL) {
+            inodeNum = 0;
+            break;
+        }
+        if (inode->type == INODE_SYMLINK 
+                && (!lastInPath || numFrames > 0 || followLast)) {
+            if (numPinned == MAXSYMLINKS) {
+                inodeNum = 0;
+                break;
+            }
+            // go on with the link's target, from the directory the link is
+            // in, and come back for the rest of this path afterwards
+            int dataBlockNum = inode->direct[0];
+            if (dataBlockNum <= 0) {
+                inodeNum = 0;
+                break;
+            }
+            // with every frame pinned the target cannot be read
+            char *target = (char *)getMetadataBlock(dataBlockNum);
+            if (target == NULL) {
+                inodeNum = 0;
+                break;
+            }
+            pinBlock(dataBlockNum);
+            pinned[numPinned++] = dataBlockNum;
+            if (!lastInPath) {
+                frames[numFrames].rest = rest;
+                frames[numFrames].inLink = inLink;
+                numFrames++;
+            }
+            inLink = true;
+            path = target;
+            inodeNum = dirInodeNum;
+            if (path[0] == '/') {
+                inodeNum = ROOTINODE;
+            }
+            while (path[0] == '/') {
+                path++;
+            }
+            if (path[0] != '\0') {
+                continue;
+            }
+            // an empty target names the directory the link is in
+            rest = path;
+            lastInPath = true;
+        }
+        
+        path = rest;
+        if (lastInPath && numFrames > 0) {
+            numFrames--;
+            path = frames[numFrames].rest;
+            inLink = frames[numFrames].inLink;
+        }
+    }
+    
+    while (numPinned > 0) {
+        unpinBlock(pinned[--numPinned]);
+    }
+    return inodeNum;
+}
+
+
+/*
+ * Set inode to free and mark it free in the inode bitmap
+ */
+void
+freeUpInode(int inodeNum) {
+    // get address of this inode 
+    struct inode *inode = getInode(inodeNum);
+    
+    // modify the type of inode to free
+    inode->type = INODE_FREE;
+
+    markInodeFree(inodeNum);
+    // if it was a directory, the names cached in it are gone with it
+    dcache_remove_dir(nameCache, inodeNum);
+    forgetFreeSlots(inodeNum);
+
+    saveInode(inodeNum);
+}
+
+/*
+ * Returns the first free inode in the inode table block with the given
+ * index, which must have one
+ */
+static int
+firstFreeInodeInBlock(int tableBlock) {
+    int inodeNum = tableBlock * INODESPERBLOCK;
+    int last = inodeNum + INODESPERBLOCK - 1;
+    if (last > numInodes) {
+        last = numInodes;
+    }
+    for (; inodeNum <= last; inodeNum++) {
+        if (!bitmap_test(inodeBitmap, inodeNum)) {
+            return inodeNum;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Allocates a free inode as close as possible to the parent directory's
+ * inode: in the same inode table block if it has a free inode, otherwise
+ * in the nearest block that does, so that stat'ing the entries of a
+ * directory touches few inode table blocks. Returns 0 if there is none
+ */
+int
+getNextFreeInodeNum(int parentInodeNum) {
+    if (freeInodeCount == 0) {
+        return 0;
+    }
+    int home = parentInodeNum / INODESPERBLOCK;
+    int tableBlock = -1;
+    int distance;
+    for (distance = 0; tableBlock < 0; distance++) {
+        if (home + distance < numInodeTableBlocks 
+                && freeInodesPerBlock[home + distance] > 0) {
+            tableBlock = home + distance;
+        } else if (home - distance >= 0 
+                && freeInodesPerBlock[home - distance] > 0) {
+            tableBlock = home - distance;
+        } else if (home + distance >= numInodeTableBlocks 
+                && home - distance < 0) {
+            return 0;
+        }
+    }
+    int inodeNum = firstFreeInodeInBlock(tableBlock);
+    if (inodeNum == 0) {
+        return 0;
+    }
+    // a free inode left by an older server may still list the blocks it
+    // had, which are free now
+    struct inode *inode = getInode(inodeNum);
+    inode->reuse++;
+    memset(inode->direct, 0, sizeof(inode->direct));
+    inode->indirect = 0;
+    saveInode(inodeNum);
+    freeInodeCount--;
+    freeInodesPerBlock[tableBlock]--;
+    bitmap_set(inodeBitmap, inodeNum);
+    bitmapsDirty = true;
+    return inodeNum;
+}
+
+void
+markInodeFree(int inodeNum) {
+    freeInodeCount++;
+    freeInodesPerBlock[inodeNum / INODESPERBLOCK]++;
+    bitmap_clear(inodeBitmap, inodeNum);
+    bitmapsDirty = true;
+}
+
+/*
+ * Allocates the first free block at or after goal, wrapping around to the
+ * start of the disk, or returns 0 if the disk is full
+ */
+int
+allocateBlockNear(int goal) {
+    // the blocks reserved for delayed blocks are not up for grabs
+    if (freeBlockCount <= reservedBlockCount) {
+        return 0;
+    }
+    if (goal < firstFreeBlockHint) {
+        goal = firstFreeBlockHint;
+    }
+    int blockNum = bitmap_find_clear(blockBitmap, numBlocks, goal);
+    if (blockNum == -1) {
+        return 0;
+    }
+    markBlockTaken(blockNum);
+    if (blockNum == firstFreeBlockHint) {
+        firstFreeBlockHint++;
+    }
+    return blockNum;
+}
+
+/*
+ * Allocates the next block of a growing file. If goal, the block after the
+ * file's last one, is free, that is it. Otherwise the file has to jump
+ * anyway, so rather than continuing in the first small hole after goal it
+ * moves on to the first run of at least MIN_FREE_RUN free blocks, where it
+ * can keep growing contiguously, if there is one.
+ */
+int
+allocateNextBlock(int goal) {
+    if (goal > 0 && goal < numBlocks && !bitmap_test(blockBitmap, goal)) {
+        return allocateBlockNear(goal);
+    }
+    int runStart = bitmap_find_clear_run(blockBitmap, numBlocks, goal, MIN_FREE_RUN);
+    if (runStart != -1) {
+        return allocateBlockNear(runStart);
+    }
+    return allocateBlockNear(goal);
+}
+
+/*
+ * Allocates the lowest numbered free block, or returns 0 if the disk is
+ * full
+ */
+int getNextFreeBlockNum() {
+    return allocateBlockNear(firstFreeBlockHint);
+}
+
+void
+markBlockTaken(int blockNum) {
+    if (!bitmap_test(blockBitmap, blockNum)) {
+        bitmap_set(blockBitmap, blockNum);
+        freeBlockCount--;
+        bitmapsDirty = true;
+    }
+}
+
+void
+markBlockFree(int blockNum) {
+    if (bitmap_test(blockBitmap, blockNum)) {
+        bitmap_clear(blockBitmap, blockNum);
+        freeBlockCount++;
+        bitmapsDirty = true;
+        if (blockNum < firstFreeBlockHint) {
+            firstFreeBlockHint = blockNum;
+        }
+    }
+}
+
+/*
+ * Reads count bitmap blocks starting at block start into map, which has
+ * nbits bits
+ */
+static void
+readBitmap(int start, int count, unsigned int *map, int nbits) {
+    char buf[BLOCKSIZE];
+    int bytes = BITMAP_WORDS(nbits) * sizeof(unsigned int);
+    int i;
+    for (i = 0; i < count && i * BLOCKSIZE < bytes; i++) {
+        ReadSector(start + i, buf);
+        int chunk = bytes - i * BLOCKSIZE < BLOCKSIZE ? bytes - i * BLOCKSIZE : BLOCKSIZE;
+        memcpy((char *)map + i * BLOCKSIZE, buf, chunk);
+    }
+}
+
+/*
+ * Writes map, which has nbits bits, to the count bitmap blocks starting at
+ * block start
+ */
+static void
+writeBitmap(int start, int count, unsigned int *map, int nbits) {
+    char buf[BLOCKSIZE];
+    int bytes = BITMAP_WORDS(nbits) * sizeof(unsigned int);
+    int i;
+    for (i = 0; i < count; i++) {
+        memset(buf, 0, BLOCKSIZE);
+        if (i * BLOCKSIZE < bytes) {
+            int chunk = bytes - i * BLOCKSIZE < BLOCKSIZE ? bytes - i * BLOCKSIZE : BLOCKSIZE;
+            memcpy(buf, (char *)map + i * BLOCKSIZE, chunk);
+        }
+        WriteSector(start + i, buf);
+    }
+}
+
+/*
+ * Writes both bitmaps to disk if they changed since they were last written
+ */
+void
+writeBitmaps(void) {
+    if (!bitmapsOnDisk || !bitmapsDirty) {
+        return;
+    }
+    writeBitmap(diskHeader.inode_bitmap_start, diskHeader.inode_bitmap_blocks,
+        inodeBitmap, numInodes + 1);
+    writeBitmap(diskHeader.block_bitmap_start, diskHeader.block_bitmap_blocks,
+        blockBitmap, numBlocks);
+    blockCacheStats.writebacks += diskHeader.inode_bitmap_blocks + diskHeader.block_bitmap_blocks;
+    bitmapsDirty = false;
+}
+
+/*
+ * Sets the clean flag in the header on disk. The header shares block 1
+ * with the first inodes, so if the block is cached, the cached copy is
+ * updated and written, or a later write-back would undo the change.
+ */
+void
+setCleanFlag(int clean) {
+    if (!bitmapsOnDisk) {
+        return;
+    }
+    diskHeader.clean = clean;
+    cacheItem *blockItem = (cacheItem *)int_table_lookup(blockTable, 1);
+    if (blockItem != NULL) {
+        ((struct yfs_header *)blockItem->addr)->clean = clean;
+        WriteSector(1, blockItem->addr);
+        blockItem->dirty = false;
+        return;
+    }
+    char block[BLOCKSIZE];
+    ReadSector(1, block);
+    ((struct yfs_header *)block)->clean = clean;
+    WriteSector(1, block);
+}
+
+/*
+ * Marks the blocks of a file that are listed in slots (the ones before
+ * numSlots) as taken, ignoring empty slots and numbers that are not
+ * blocks of the disk
+ */
+static void
+markSlotsTaken(int *slots, int numSlots) {
+    int n;
+    for (n = 0; n < numSlots; n++) {
+        // preallocated blocks are stored negated
+        int blockNum = abs(slots[n]);
+        if (blockNum > 0 && blockNum < numBlocks) {
+            markBlockTaken(blockNum);
+        }
+    }
+}
+
+/*
+ * Finds the free inodes and blocks by reading every inode in the inode
+ * table and following its block map.
+ * 
+ * This reads the disk directly, one inode table block after the other into
+ * a scratch buffer, plus the indirect block of each file that has one, so
+ * that the scan neither goes through nor disturbs the caches.
+ */
+static void
+scanInodeTable(void) {
+    char inodeBlock[BLOCKSIZE];
+    int indirectBlock[BLOCKSIZE / sizeof(int)];
+    int sectorsRead = 0;
+    
+    // every block starts out free, except for sector 0, the boot block,
+    // the blocks holding the inode table and the bitmaps
+    int numInodeBlocks = ((numInodes + 1) * INODESIZE + BLOCKSIZE - 1) / BLOCKSIZE;
+    int i;
+    for (i = 0; i <= numInodeBlocks; i++) {
+        markBlockTaken(i);
+    }
+    if (bitmapsOnDisk) {
+        for (i = 0; i < diskHeader.inode_bitmap_blocks; i++) {
+            markBlockTaken(diskHeader.inode_bitmap_start + i);
+        }
+        for (i = 0; i < diskHeader.block_bitmap_blocks; i++) {
+            markBlockTaken(diskHeader.block_bitmap_start + i);
+        }
+    }
+    bitmap_set(inodeBitmap, 0);
     
-    int blockNum = 1;
-    void *block = getBlock(blockNum);
+    // for each block that contains inodes
+    int blockNum;
+    for (blockNum = 1; blockNum <= numInodeBlocks; blockNum++) {
+        ReadSector(blockNum, inodeBlock);
+        sectorsRead++;
+        bool inodeBlockDirty = false;
+        int firstInodeNum = (blockNum - 1) * INODESPERBLOCK;
+        // slot 0 of block 1 is the header
+        i = blockNum == 1 ? ROOTINODE : 0;
+        for (; i < INODESPERBLOCK && firstInodeNum + i <= numInodes; i++) {
+            struct inode *inode = (struct inode *)(inodeBlock + i * INODESIZE);
+            int inodeNum = firstInodeNum + i;
+            // if it's free, count it as free in its block
+            if (inode->type == INODE_FREE) {
+                markInodeFree(inodeNum);
+                continue;
+            }
+            // otherwise keep track of all its blocks as taken
+            bitmap_set(inodeBitmap, inodeNum);
+            int numFileBlocks = (inode->size + BLOCKSIZE - 1) / BLOCKSIZE;
+            markSlotsTaken(inode->direct, 
+                numFileBlocks < NUM_DIRECT ? numFileBlocks : NUM_DIRECT);
+            // older servers truncated files without clearing their block
+            // map, and the blocks past the end are free; they must not be
+            // reused when the file grows again
+            int n;
+            for (n = numFileBlocks; n < NUM_DIRECT; n++) {
+                if (inode->direct[n] != 0) {
+                    inode->direct[n] = 0;
+                    inodeBlockDirty = true;
+                }
+            }
+            if (numFileBlocks <= NUM_DIRECT && inode->indirect != 0) {
+                inode->indirect = 0;
+                inodeBlockDirty = true;
+            }
+            if (inode->indirect > 0 && inode->indirect < numBlocks) {
+                markBlockTaken(inode->indirect);
+                ReadSector(inode->indirect, indirectBlock);
+                sectorsRead++;
+                int numIndirect = numFileBlocks - NUM_DIRECT;
+                if (numIndirect > BLOCKSIZE / (int)sizeof(int)) {
+                    numIndirect = BLOCKSIZE / (int)sizeof(int);
+                }
+                markSlotsTaken(indirectBlock, numIndirect);
+                bool indirectDirty = false;
+                for (n = numIndirect; n < BLOCKSIZE / (int)sizeof(int); n++) {
+                    if (indirectBlock[n] != 0) {
+                        indirectBlock[n] = 0;
+                        indirectDirty = true;
+                    }
+                }
+                if (indirectDirty) {
+                    WriteSector(inode->indirect, indirectBlock);
+                }
+            }
+        }
+        if (inodeBlockDirty) {
+            WriteSector(blockNum, inodeBlock);
+        }
+    }
+    TracePrintf(1, "scan read %d sectors (%d inode table blocks, %d indirect blocks)\n",
+        sectorsRead, numInodeBlocks, sectorsRead - numInodeBlocks);
+}
+
+/*
+ * Loads the bitmaps from disk, and counts the free inodes of each inode
+ * table block from the inode bitmap
+ */
+static void
+loadBitmaps(void) {
+    readBitmap(diskHeader.inode_bitmap_start, diskHeader.inode_bitmap_blocks,
+        inodeBitmap, numInodes + 1);
+    readBitmap(diskHeader.block_bitmap_start, diskHeader.block_bitmap_blocks,
+        blockBitmap, numBlocks);
+    int i;
+    freeBlockCount = 0;
+    for (i = 0; i < numBlocks; i++) {
+        if (!bitmap_test(blockBitmap, i)) {
+            freeBlockCount++;
+        }
+    }
+    for (i = ROOTINODE; i <= numInodes; i++) {
+        if (!bitmap_test(inodeBitmap, i)) {
+            freeInodeCount++;
+            freeInodesPerBlock[i / INODESPERBLOCK]++;
+        }
+    }
+}
+
+/*
+ * Brings the root directory's inode and its first blocks into the cache,
+ * as every absolute path lookup starts there
+ */
+static void
+warmCache(void) {
+    struct inode *root = getInode(ROOTINODE);
+    int n;
+    int warmBlocks = partitions[METADATA_PARTITION].budget / 4;
+    for (n = 0; n < warmBlocks; n++) {
+        int blockNum = getNthBlock(root, ROOTINODE, n, false);
+        if (blockNum == 0) {
+            break;
+        }
+        getMetadataBlock(blockNum);
+    }
+    releaseInodePins();
+}
+
+void
+buildFreeInodeAndBlockLists() {
+    
+    // read the header without caching its block, which the scan below
+    // reads directly as well
+    char block[BLOCKSIZE];
+    ReadSector(1, block);
+    diskHeader = *((struct yfs_header *) block);
+    
+    TracePrintf(1, "num_blocks: %d, num_inodes: %d\n", diskHeader.num_blocks,
+        diskHeader.num_inodes);
+    
+    numBlocks = diskHeader.num_blocks;
+    numInodes = diskHeader.num_inodes;
+    blockBitmap = bitmap_create(numBlocks);
+    inodeBitmap = bitmap_create(numInodes + 1);
+    numInodeTableBlocks = (numInodes + INODESPERBLOCK) / INODESPERBLOCK;
+    freeInodesPerBlock = calloc(numInodeTableBlocks, sizeof(int));
+    blockGoals = calloc(numInodes + 1, sizeof(int));
+    indirectReserved = calloc(numInodes + 1, sizeof(bool));
+    if (blockBitmap == NULL || inodeBitmap == NULL || freeInodesPerBlock == NULL
+            || blockGoals == NULL || indirectReserved == NULL) {
+        TracePrintf(1, "error allocating the free inode and block bitmaps\n");
+        Exit(1);
+    }
+    freeBlockCount = numBlocks;
+    
+    bitmapsOnDisk = diskHeader.magic == YFS_MAGIC || diskHeader.magic == YFS_MAGIC_V1;
+    unwrittenOnDisk = diskHeader.magic == YFS_MAGIC;
+    if (bitmapsOnDisk && diskHeader.clean) {
+        loadBitmaps();
+        bitmapsDirty = false;
+        TracePrintf(1, "loaded the bitmaps from disk\n");
+    } else {
+        scanInodeTable();
+        bitmapsDirty = bitmapsOnDisk;
+        TracePrintf(1, "scanned the inode table%s\n", bitmapsOnDisk 
+            ? ", as the server was not shut down cleanly" : "");
+    }
+    // the bitmaps on disk go stale as soon as anything is allocated, so
+    // until the next clean shutdown a restart has to scan
+    setCleanFlag(0);
+    warmCache();
+    TracePrintf(1, "initialized free inode bitmap with %d free inodes\n", 
+        freeInodeCount);
+    TracePrintf(1, "initialized free block bitmap with %d free blocks\n", 
+        freeBlockCount);
+    
+}
+
+static bool dropDirectoryIndex(int dirInodeNum);
+
+void
+clearFile(struct inode *inode, int inodeNum) {
+    int i;
+    int blockNum;
+    // a directory's index goes with it, and so do the names cached in it;
+    // freeing the index may evict the inode
+    if (inode->type == INODE_DIRECTORY) {
+        dcache_remove_dir(nameCache, inodeNum);
+        forgetFreeSlots(inodeNum);
+        if (dropDirectoryIndex(inodeNum)) {
+            inode = getInode(inodeNum);
+        }
+    }
+    // the file is likely to be rewritten, so put it back where it was
+    if (inode->direct[0] != 0) {
+        blockGoals[inodeNum] = inode->direct[0];
+    }
+    // holes have no block to free
+    for (i = 0; i * BLOCKSIZE < inode->size; i++) {
+        blockNum = getNthBlock(inode, inodeNum, i, false);
+        if (blockNum >= numBlocks) {
+            discardDelayedBlock(blockNum);
+        } else if (blockNum != 0) {
+            markBlockFree(abs(blockNum));
+        }
+    }
+    releaseIndirectReservation(inodeNum);
+    for (i = 0; i < NUM_DIRECT; i++) {
+        inode->direct[i] = 0;
+    }
+    if (inode->indirect != 0) {
+        markBlockFree(inode->indirect);
+        inode->indirect = 0;
+    }
+    inode->size = 0;
+    saveInode(inodeNum);
+}
+
+/*
+ * Returns the hash of the name at the start of path, which ends at a '/',
+ * at a NUL or after DIRNAMELEN characters like in isEqual()
+ */
+static unsigned int
+hashDirName(char *path) {
+    unsigned int hash = 2166136261u;
+    int i;
+    for (i = 0; i < DIRNAMELEN && path[i] != '\0' && path[i] != '/'; i++) {
+        hash = (hash ^ (unsigned char)path[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/*
+ * Returns the offset of entry entryNum of the directory in its block, and
+ * puts the block's number in blockNumPtr (0 if the directory has no such
+ * block)
+ */
+static int
+getEntryLocation(int dirInodeNum, int entryNum, int *blockNumPtr) {
+    struct inode *dir = getInode(dirInodeNum);
+    *blockNumPtr = getNthBlock(dir, dirInodeNum, entryNum / DIR_ENTRIES_PER_BLOCK, false);
+    return (entryNum % DIR_ENTRIES_PER_BLOCK) * sizeof(struct dir_entry);
+}
+
+/*
+ * Returns a pointer to entry entryNum of the directory in the block cache,
+ * or NULL, and puts the number of its block in blockNumPtr
+ */
+static struct dir_entry *
+getEntryByNumber(int dirInodeNum, int entryNum, int *blockNumPtr) {
+    int offset = getEntryLocation(dirInodeNum, entryNum, blockNumPtr);
+    if (*blockNumPtr <= 0) {
+        return NULL;
+    }
+    char *block = getMetadataBlock(*blockNumPtr);
+    if (block == NULL) {
+        return NULL;
+    }
+    return (struct dir_entry *)(block + offset);
+}
+
+static int getDirectoryIndex(int dirInodeNum);
+
+/*
+ * Returns the summary of the directory's free entries, building it first by
+ * reading the whole directory if it is not there or out of date. An
+ * indexed directory's marker does not count as free.
+ */
+static struct dirFreeSlots *
+getFreeSlots(int dirInodeNum) {
+    struct dirFreeSlots *slots = &dirFreeSlots[dirInodeNum % FREE_SLOT_DIRS];
+    int size = getInode(dirInodeNum)->size;
+    if (slots->inodeNum == dirInodeNum && slots->size == size) {
+        return slots;
+    }
+    bool indexed = getDirectoryIndex(dirInodeNum) != 0;
+    slots->inodeNum = dirInodeNum;
+    slots->size = size;
+    slots->numBlocks = 0;
+    int numEntries = size / sizeof(struct dir_entry);
+    int n;
+    for (n = 0; n * DIR_ENTRIES_PER_BLOCK < numEntries; n++) {
+        int blockNum = getNthBlock(getInode(dirInodeNum), dirInodeNum, n, false);
+        slots->blocks[n] = blockNum;
+        slots->freeEntries[n] = 0;
+        slots->numBlocks++;
+        if (blockNum <= 0) {
+            continue;
+        }
+        struct dir_entry *entries = getMetadataBlock(blockNum);
+        int i;
+        for (i = 0; i < DIR_ENTRIES_PER_BLOCK 
+                && n * DIR_ENTRIES_PER_BLOCK + i < numEntries; i++) {
+            if (entries[i].inum == 0 
+                    && !(indexed && n * DIR_ENTRIES_PER_BLOCK + i == DIR_INDEX_ENTRY)) {
+                slots->freeEntries[n]++;
+            }
+        }
+    }
+    return slots;
+}
+
+/*
+ * Drops the summary of the directory's free entries, if there is one
+ */
+void
+forgetFreeSlots(int dirInodeNum) {
+    struct dirFreeSlots *slots = &dirFreeSlots[dirInodeNum % FREE_SLOT_DIRS];
+    if (slots->inodeNum == dirInodeNum) {
+        slots->inodeNum = 0;
+    }
+}
+
+/*
+ * Counts an entry in the given block of the directory as freed (if delta
+ * is 1) or taken (if delta is -1), if the directory has a summary
+ */
+static void
+noteFreeSlot(int dirInodeNum, int blockNum, int delta) {
+    struct dirFreeSlots *slots = &dirFreeSlots[dirInodeNum % FREE_SLOT_DIRS];
+    if (slots->inodeNum != dirInodeNum) {
+        return;
+    }
+    int n;
+    for (n = 0; n < slots->numBlocks; n++) {
+        if (slots->blocks[n] == blockNum) {
+            if (slots->freeEntries[n] + delta >= 0) {
+                slots->freeEntries[n] += delta;
+            }
+            return;
+        }
+    }
+}
+
+/*
+ * Takes a free entry of the directory, from the first block the summary
+ * says has one. Returns its entry number, or -1 if there is none. The
+ * entry may still have the name it had before it was freed.
+ */
+static int
+takeFreeSlot(int dirInodeNum) {
+    struct dirFreeSlots *slots = getFreeSlots(dirInodeNum);
+    bool indexed = getDirectoryIndex(dirInodeNum) != 0;
+    int numEntries = slots->size / sizeof(struct dir_entry);
+    int n;
+    for (n = 0; n < slots->numBlocks; n++) {
+        if (slots->freeEntries[n] == 0 || slots->blocks[n] <= 0) {
+            continue;
+        }
+        struct dir_entry *entries = getMetadataBlock(slots->blocks[n]);
+        int i;
+        for (i = 0; i < DIR_ENTRIES_PER_BLOCK; i++) {
+            int entryNum = n * DIR_ENTRIES_PER_BLOCK + i;
+            if (entryNum < numEntries && entries[i].inum == 0
+                    && !(indexed && entryNum == DIR_INDEX_ENTRY)) {
+                slots->freeEntries[n]--;
+                return entryNum;
+            }
+        }
+        // the summary was off; it only ever undercounts after this
+        slots->freeEntries[n] = 0;
+    }
+    return -1;
+}
+
+/*
+ * Adds a free entry at the end of the directory, allocating a new block
+ * for it if needed. Returns its entry number, or -1 if the directory
+ * cannot grow.
+ */
+static int
+appendDirectoryEntry(int dirInodeNum) {
+    struct inode *dir = getInode(dirInodeNum);
+    int entryNum = dir->size / sizeof(struct dir_entry);
+    int blockNum;
+    if (dir->size % BLOCKSIZE == 0) {
+        // we're at the bottom edge of the block, so we need to allocate a
+        // new block, which starts out with free (zeroed) entries only
+        blockNum = getNthBlock(dir, dirInodeNum, dir->size / BLOCKSIZE, true);
+        if (blockNum == 0 || getMetadataBlockForOverwrite(blockNum) == NULL) {
+            return -1;
+        }
+    }
+    // the new entry is handed out, so the summary only has to follow the
+    // directory's size and blocks
+    struct dirFreeSlots *slots = &dirFreeSlots[dirInodeNum % FREE_SLOT_DIRS];
+    if (slots->inodeNum == dirInodeNum && slots->size == dir->size) {
+        if (dir->size % BLOCKSIZE == 0) {
+            slots->blocks[slots->numBlocks] = blockNum;
+            slots->freeEntries[slots->numBlocks] = 0;
+            slots->numBlocks++;
+        }
+        slots->size += sizeof(struct dir_entry);
+    }
+    dir->size += sizeof(struct dir_entry);
+    saveInode(dirInodeNum);
+    // the entry after the last one may hold an old name; if its block
+    // cannot be read the directory shrinks back, and a new block stays
+    // mapped past its end for the next time it grows
+    struct dir_entry *entry = getEntryByNumber(dirInodeNum, entryNum, &blockNum);
+    if (entry == NULL) {
+        dir = getInode(dirInodeNum);
+        dir->size -= sizeof(struct dir_entry);
+        saveInode(dirInodeNum);
+        forgetFreeSlots(dirInodeNum);
+        return -1;
+    }
+    memset(entry, 0, sizeof(struct dir_entry));
+    saveBlock(blockNum);
+    return entryNum;
+}
+
+/*
+ * Returns a pointer to the directory's index marker in the block cache,
+ * and puts the number of its block in blockNumPtr, or returns NULL if the
+ * directory has no index
+ */
+static struct dir_index_marker *
+getIndexMarker(int dirInodeNum, int *blockNumPtr) {
+    struct inode *dir = getInode(dirInodeNum);
+    if (dir->type != INODE_DIRECTORY 
+            || dir->size < (DIR_INDEX_ENTRY + 1) * (int)sizeof(struct dir_entry)) {
+        return NULL;
+    }
+    struct dir_index_marker *marker = (struct dir_index_marker *)
+        getEntryByNumber(dirInodeNum, DIR_INDEX_ENTRY, blockNumPtr);
+    if (marker == NULL || marker->inum != 0 || marker->zero != '\0'
+            || memcmp(marker->magic, DIR_INDEX_MAGIC, sizeof(marker->magic)) != 0) {
+        return NULL;
+    }
+    return marker;
+}
+
+/*
+ * Returns the inode number of the directory's index, or 0 if it has none
+ */
+static int
+getDirectoryIndex(int dirInodeNum) {
+    int blockNum;
+    struct dir_index_marker *marker = getIndexMarker(dirInodeNum, &blockNum);
+    if (marker == NULL) {
+        return 0;
+    }
+    int indexInodeNum = marker->index_inode;
+    if (indexInodeNum <= 0 || indexInodeNum > numInodes 
+            || getInode(indexInodeNum)->type != INODE_REGULAR) {
+        return 0;
+    }
+    return indexInodeNum;
+}
+
+/*
+ * Returns a pointer to slot number slot of the index in the block cache,
+ * or NULL, and puts the number of its block in blockNumPtr
+ */
+static unsigned short *
+getIndexSlot(int indexInodeNum, int slot, int *blockNumPtr) {
+    struct inode *index = getInode(indexInodeNum);
+    *blockNumPtr = getNthBlock(index, indexInodeNum, slot / INDEX_SLOTS_PER_BLOCK, false);
+    if (*blockNumPtr <= 0) {
+        return NULL;
+    }
+    unsigned short *slots = getMetadataBlock(*blockNumPtr);
+    if (slots == NULL) {
+        return NULL;
+    }
+    return slots + slot % INDEX_SLOTS_PER_BLOCK;
+}
+
+/*
+ * Adds entry entryNum, named name, to the index, which must have a free
+ * slot. Returns ERROR if a block of the index cannot be read.
+ */
+static int
+insertIntoDirectoryIndex(int indexInodeNum, char *name, int entryNum) {
+    int mask = getInode(indexInodeNum)->size / sizeof(unsigned short) - 1;
+    int slot = hashDirName(name) & mask;
+    int blockNum;
+    unsigned short *slotPtr;
+    while ((slotPtr = getIndexSlot(indexInodeNum, slot, &blockNum)) != NULL
+            && *slotPtr != 0) {
+        slot = (slot + 1) & mask;
+    }
+    if (slotPtr == NULL) {
+        return ERROR;
+    }
+    *slotPtr = entryNum;
+    saveBlock(blockNum);
+    return 0;
+}
+
+/*
+ * Returns the number of the entry of the directory that has the given name
+ * according to its index, or -1 if there is none. If a block of the index
+ * or of the directory cannot be read, failedPtr is set and -1 returned.
+ */
+static int
+lookupDirectoryIndex(int dirInodeNum, int indexInodeNum, char *name, bool *failedPtr) {
+    int mask = getInode(indexInodeNum)->size / sizeof(unsigned short) - 1;
+    int slot = hashDirName(name) & mask;
+    int probes;
+    *failedPtr = false;
+    for (probes = 0; probes <= mask; probes++) {
+        int blockNum;
+        unsigned short *slotPtr = getIndexSlot(indexInodeNum, slot, &blockNum);
+        if (slotPtr == NULL) {
+            *failedPtr = true;
+            return -1;
+        }
+        if (*slotPtr == 0) {
+            return -1;
+        }
+        int entryNum = *slotPtr;
+        struct dir_entry *entry = getEntryByNumber(dirInodeNum, entryNum, &blockNum);
+        if (entry == NULL) {
+            *failedPtr = true;
+            return -1;
+        }
+        if (entry->inum != 0 && isEqual(name, entry->name)) {
+            return entryNum;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return -1;
+}
+
+/*
+ * Removes entry entryNum, named name, from the index. The entries after it
+ * in its probe sequence are shifted back into the freed slot where they
+ * can be, so that lookups never have to skip over deleted slots. Returns
+ * ERROR if a block of the index or of the directory cannot be read, which
+ * may leave the index half updated.
+ */
+static int
+removeFromDirectoryIndex(int dirInodeNum, int indexInodeNum, char *name, int entryNum) {
+    int mask = getInode(indexInodeNum)->size / sizeof(unsigned short) - 1;
+    int hole = hashDirName(name) & mask;
+    int blockNum;
+    unsigned short *slotPtr;
+    int probes;
+    for (probes = 0; probes <= mask; probes++) {
+        slotPtr = getIndexSlot(indexInodeNum, hole, &blockNum);
+        if (slotPtr == NULL) {
+            return ERROR;
+        }
+        if (*slotPtr == 0) {
+            return 0;
+        }
+        if (*slotPtr == entryNum) {
+            break;
+        }
+        hole = (hole + 1) & mask;
+    }
+    if (probes > mask) {
+        return 0;
+    }
+    int next = hole;
+    while (true) {
+        next = (next + 1) & mask;
+        slotPtr = getIndexSlot(indexInodeNum, next, &blockNum);
+        if (slotPtr == NULL) {
+            return ERROR;
+        }
+        if (*slotPtr == 0) {
+            break;
+        }
+        int movedEntryNum = *slotPtr;
+        struct dir_entry *entry = getEntryByNumber(dirInodeNum, movedEntryNum, &blockNum);
+        if (entry == NULL) {
+            return ERROR;
+        }
+        int home = hashDirName(entry->name) & mask;
+        // the entry can move back unless its home slot is after the hole
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            slotPtr = getIndexSlot(indexInodeNum, hole, &blockNum);
+            if (slotPtr == NULL) {
+                return ERROR;
+            }
+            *slotPtr = movedEntryNum;
+            saveBlock(blockNum);
+            hole = next;
+        }
+    }
+    slotPtr = getIndexSlot(indexInodeNum, hole, &blockNum);
+    if (slotPtr == NULL) {
+        return ERROR;
+    }
+    *slotPtr = 0;
+    saveBlock(blockNum);
+    return 0;
+}
+
+/*
+ * Makes the directory's index numSlots slots long and fills it with every
+ * entry of the directory that has a name. Returns ERROR if there are not
+ * enough free blocks for it, or if a block of the directory or the index
+ * cannot be read; the caller then drops the index.
+ */
+static int
+fillDirectoryIndex(int dirInodeNum, int indexInodeNum, int numSlots) {
+    struct inode *index = getInode(indexInodeNum);
+    clearFile(index, indexInodeNum);
+    int i;
+    for (i = 0; i * INDEX_SLOTS_PER_BLOCK < numSlots; i++) {
+        index = getInode(indexInodeNum);
+        int blockNum = getNthBlock(index, indexInodeNum, i, true);
+        if (blockNum == 0) {
+            saveInode(indexInodeNum);
+            return ERROR;
+        }
+        // count the block in the size even if it cannot be cleared, so
+        // that clearFile() frees it when the index is dropped
+        index->size = (i + 1) * BLOCKSIZE;
+        saveInode(indexInodeNum);
+        if (getMetadataBlockForOverwrite(blockNum) == NULL) {
+            return ERROR;
+        }
+    }
     
-    struct fs_header header = *((struct fs_header*) block);
+    int numEntries = getInode(dirInodeNum)->size / sizeof(struct dir_entry);
+    int used = 0;
+    int entryNum;
+    for (entryNum = DIR_INDEX_ENTRY + 1; entryNum < numEntries; entryNum++) {
+        int blockNum;
+        struct dir_entry *entry = getEntryByNumber(dirInodeNum, entryNum, &blockNum);
+        if (entry == NULL) {
+            return ERROR;
+        }
+        if (entry->name[0] == '\0') {
+            continue;
+        }
+        // the entry's block may be evicted while the index is written
+        char name[DIRNAMELEN + 1];
+        memcpy(name, entry->name, DIRNAMELEN);
+        name[DIRNAMELEN] = '\0';
+        if (insertIntoDirectoryIndex(indexInodeNum, name, entryNum) == ERROR) {
+            return ERROR;
+        }
+        used++;
+    }
+    int blockNum;
+    struct dir_index_marker *marker = getIndexMarker(dirInodeNum, &blockNum);
+    if (marker == NULL) {
+        return ERROR;
+    }
+    marker->used = used;
+    saveBlock(blockNum);
+    return 0;
+}
+
+/*
+ * Removes the directory's index, if it has one, and frees its inode. The
+ * directory is then searched by scanning it again. Returns true if there
+ * was an index.
+ */
+static bool
+dropDirectoryIndex(int dirInodeNum) {
+    int blockNum;
+    struct dir_index_marker *marker = getIndexMarker(dirInodeNum, &blockNum);
+    if (marker == NULL) {
+        return false;
+    }
+    int indexInodeNum = getDirectoryIndex(dirInodeNum);
+    marker = getIndexMarker(dirInodeNum, &blockNum);
+    if (marker == NULL) {
+        return false;
+    }
+    memset(marker, 0, sizeof(struct dir_index_marker));
+    saveBlock(blockNum);
+    forgetFreeSlots(dirInodeNum);
+    if (indexInodeNum != 0) {
+        clearFile(getInode(indexInodeNum), indexInodeNum);
+        freeUpInode(indexInodeNum);
+    }
+    return true;
+}
+
+/*
+ * Gives the directory a hashed index, moving the entry in the index
+ * marker's place to the end of the directory first. Returns the index's
+ * inode number, or 0 if there was no room for it.
+ */
+static int
+buildDirectoryIndex(int dirInodeNum) {
+    // get the index's inode first, so that nothing has moved if there is
+    // none
+    int indexInodeNum = getNextFreeInodeNum(dirInodeNum);
+    if (indexInodeNum == 0) {
+        return 0;
+    }
+    struct inode *index = getInode(indexInodeNum);
+    index->type = INODE_REGULAR;
+    index->size = 0;
+    index->nlink = 1;
+    saveInode(indexInodeNum);
     
-    TracePrintf(1, "num_blocks: %d, num_inodes: %d\n", header.num_blocks,
-        header.num_inodes);
+    int blockNum;
+    struct dir_entry *entry = getEntryByNumber(dirInodeNum, DIR_INDEX_ENTRY, &blockNum);
+    if (entry == NULL) {
+        freeUpInode(indexInodeNum);
+        return 0;
+    }
+    if (entry->inum != 0) {
+        struct dir_entry moved = *entry;
+        int entryNum = appendDirectoryEntry(dirInodeNum);
+        if (entryNum == -1) {
+            freeUpInode(indexInodeNum);
+            return 0;
+        }
+        // the marker written below replaces the entry's old place, so the
+        // name stays in the directory once
+        entry = getEntryByNumber(dirInodeNum, entryNum, &blockNum);
+        *entry = moved;
+        saveBlock(blockNum);
+        dcache_remove(nameCache, dirInodeNum, moved.name);
+    }
     
-    // create array indexed by block number
-    bool takenBlocks[header.num_blocks];
-    // initialize each item to false
-    memset(takenBlocks, false, header.num_blocks * sizeof(bool));
-    // sector 0 is taken
-    takenBlocks[0] = true;
+    // write the marker, with the index right after the directory's first
+    // block
+    entry = getEntryByNumber(dirInodeNum, DIR_INDEX_ENTRY, &blockNum);
+    blockGoals[indexInodeNum] = blockNum;
+    struct dir_index_marker *marker = (struct dir_index_marker *)entry;
+    memset(marker, 0, sizeof(struct dir_index_marker));
+    memcpy(marker->magic, DIR_INDEX_MAGIC, sizeof(marker->magic));
+    marker->index_inode = indexInodeNum;
+    saveBlock(blockNum);
     
-    // for each block that contains inodes
-    int inodeNum = ROOTINODE;
-    while (inodeNum < header.num_inodes) {
-        // for each inode, if it's free, add it to the free list
-        for (; inodeNum < INODESPERBLOCK * blockNum; inodeNum++) {
-            struct inode *inode = getInode(inodeNum);
-            if (inode->type == INODE_FREE) {
-                addFreeInodeToList(inodeNum);
-            } else {
-                // keep track of all these blocks as taken
-                int i = 0;
-                int blockNum;
-                while((blockNum = getNthBlock(inode, i++, false)) != 0) {
-                    takenBlocks[blockNum] = true;
-                }
-            }
+    // start out at most a quarter full
+    int numEntries = getInode(dirInodeNum)->size / sizeof(struct dir_entry);
+    int numSlots = INDEX_SLOTS_PER_BLOCK;
+    while (numSlots < 4 * numEntries) {
+        numSlots *= 2;
+    }
+    if (fillDirectoryIndex(dirInodeNum, indexInodeNum, numSlots) == ERROR) {
+        dropDirectoryIndex(dirInodeNum);
+        return 0;
+    }
+    // the marker took the place of an entry that may have been free
+    forgetFreeSlots(dirInodeNum);
+    TracePrintf(1, "indexed directory %d (%d entries) in inode %d\n",
+        dirInodeNum, numEntries, indexInodeNum);
+    return indexInodeNum;
+}
+
+/*
+ * Takes a free entry of an indexed directory, taking its old name out of
+ * the index. Returns its entry number, or -1 if there is none. If the index
+ * cannot be updated it is dropped.
+ */
+static int
+findFreeDirectoryEntry(int dirInodeNum, int indexInodeNum) {
+    int entryNum = takeFreeSlot(dirInodeNum);
+    if (entryNum == -1) {
+        return -1;
+    }
+    int blockNum;
+    struct dir_entry *entry = getEntryByNumber(dirInodeNum, entryNum, &blockNum);
+    if (entry == NULL) {
+        return -1;
+    }
+    if (entry->name[0] != '\0') {
+        char name[DIRNAMELEN + 1];
+        memcpy(name, entry->name, DIRNAMELEN);
+        name[DIRNAMELEN] = '\0';
+        if (removeFromDirectoryIndex(dirInodeNum, indexInodeNum, name, entryNum) == ERROR) {
+            dropDirectoryIndex(dirInodeNum);
+            return entryNum;
+        }
+        struct dir_index_marker *marker = getIndexMarker(dirInodeNum, &blockNum);
+        if (marker != NULL) {
+            marker->used--;
+            saveBlock(blockNum);
         }
-        blockNum++;
-        block = getBlock(blockNum);
     }
-    TracePrintf(1, "initialized free inode list with %d free inodes\n", 
-        freeInodeCount);
+    return entryNum;
+}
+
+/*
+ * Adds an entry for name to an indexed directory: in a free entry, or at
+ * its end if it has none. The entry is added to the index, which doubles
+ * in size once it would be more than half full. Returns the entry's
+ * number, or -1 if there is no room for it.
+ */
+static int
+createIndexedDirectoryEntry(char *name, int dirInodeNum, int indexInodeNum) {
+    int entryNum = findFreeDirectoryEntry(dirInodeNum, indexInodeNum);
+    if (entryNum == -1) {
+        entryNum = appendDirectoryEntry(dirInodeNum);
+    }
+    if (entryNum == -1) {
+        return -1;
+    }
+    // without an index the directory is still scanned correctly, so an
+    // index that cannot be kept up to date is dropped
+    if (getDirectoryIndex(dirInodeNum) != indexInodeNum) {
+        return entryNum;
+    }
+    int blockNum;
+    struct dir_index_marker *marker = getIndexMarker(dirInodeNum, &blockNum);
+    int numSlots = getInode(indexInodeNum)->size / sizeof(unsigned short);
+    if (marker == NULL || ((marker->used + 1) * 2 > numSlots
+            && fillDirectoryIndex(dirInodeNum, indexInodeNum, numSlots * 2) == ERROR)) {
+        dropDirectoryIndex(dirInodeNum);
+        return entryNum;
+    }
+    if (insertIntoDirectoryIndex(indexInodeNum, name, entryNum) == ERROR) {
+        dropDirectoryIndex(dirInodeNum);
+        return entryNum;
+    }
+    marker = getIndexMarker(dirInodeNum, &blockNum);
+    if (marker != NULL) {
+        marker->used++;
+        saveBlock(blockNum);
+    }
+    return entryNum;
+}
+
+/*
+ * getDirectoryEntry() for a directory with an index
+ */
+static int
+getIndexedDirectoryEntry(char *pathname, int dirInodeNum, int indexInodeNum, 
+        int *blockNumPtr, bool createIfNeeded) {
+    // "." and ".." are always the first two entries, and are not indexed
+    int entryNum;
+    if (isEqual(pathname, ".")) {
+        entryNum = 0;
+    } else if (isEqual(pathname, "..")) {
+        entryNum = 1;
+    } else {
+        bool failed;
+        entryNum = lookupDirectoryIndex(dirInodeNum, indexInodeNum, pathname, &failed);
+        if (failed) {
+            // the name may be there, so it is neither cached nor created
+            *blockNumPtr = 0;
+            return -1;
+        }
+    }
+    if (entryNum != -1) {
+        struct dir_entry *entry = getEntryByNumber(dirInodeNum, entryNum, blockNumPtr);
+        if (entry == NULL) {
+            *blockNumPtr = 0;
+            return -1;
+        }
+        int offset = (entryNum % DIR_ENTRIES_PER_BLOCK) * sizeof(struct dir_entry);
+        if (createIfNeeded) {
+            dcache_remove(nameCache, dirInodeNum, pathname);
+        } else {
+            dcache_insert(nameCache, dirInodeNum, pathname, entry->inum,
+                *blockNumPtr, offset);
+        }
+        return offset;
+    }
+    *blockNumPtr = 0;
+    if (!createIfNeeded) {
+        dcache_insert(nameCache, dirInodeNum, pathname, 0, 0, 0);
+        return -1;
+    }
+    dcache_remove(nameCache, dirInodeNum, pathname);
+    entryNum = createIndexedDirectoryEntry(pathname, dirInodeNum, indexInodeNum);
+    if (entryNum == -1) {
+        return -1;
+    }
+    return getEntryLocation(dirInodeNum, entryNum, blockNumPtr);
+}
+
+/*
+ * Moves the directory's entries that are in use to its front, in order,
+ * then shrinks it to just past the last of them and frees the blocks it no
+ * longer needs. An index is dropped if too few entries are left to need
+ * it, and otherwise rebuilt for the new entry numbers. Returns how many
+ * blocks were freed.
+ */
+static int
+compactDirectory(int dirInodeNum) {
+    int numEntries = getInode(dirInodeNum)->size / sizeof(struct dir_entry);
+    int live = 0;
+    int entryNum;
+    int blockNum;
+    for (entryNum = 2; entryNum < numEntries; entryNum++) {
+        struct dir_entry *entry = getEntryByNumber(dirInodeNum, entryNum, &blockNum);
+        if (entry != NULL && entry->inum != 0) {
+            live++;
+        }
+    }
+    int indexInodeNum = getDirectoryIndex(dirInodeNum);
+    if (indexInodeNum != 0 && live < DIR_INDEX_THRESHOLD / 2) {
+        dropDirectoryIndex(dirInodeNum);
+        indexInodeNum = 0;
+    }
     
-    // for each element in the block array
-    int i;
-    for (i = 0; i < header.num_blocks; i++) {
-        if (!takenBlocks[i]) {
-            // add block to list
-            addFreeBlockToList(i);
+    // "." and "..", and the index marker, stay where they are
+    int next = indexInodeNum != 0 ? DIR_INDEX_ENTRY + 1 : 2;
+    for (entryNum = next; entryNum < numEntries; entryNum++) {
+        struct dir_entry *entry = getEntryByNumber(dirInodeNum, entryNum, &blockNum);
+        if (entry == NULL || entry->inum == 0) {
+            continue;
+        }
+        if (entryNum != next) {
+            // the entry's block may be evicted when the other one is read
+            struct dir_entry moved = *entry;
+            entry = getEntryByNumber(dirInodeNum, next, &blockNum);
+            *entry = moved;
+            saveBlock(blockNum);
         }
+        next++;
+    }
+    // entries past the new end may be handed out again by appending, which
+    // clears them, but their old names should not linger in the last block
+    if (next % DIR_ENTRIES_PER_BLOCK != 0) {
+        struct dir_entry *entry = getEntryByNumber(dirInodeNum, next, &blockNum);
+        memset(entry, 0, (DIR_ENTRIES_PER_BLOCK - next % DIR_ENTRIES_PER_BLOCK) 
+            * sizeof(struct dir_entry));
+        saveBlock(blockNum);
     }
-    TracePrintf(1, "initialized free block list with %d free blocks\n", 
-        freeBlockCount);
     
+    struct inode *dir = getInode(dirInodeNum);
+    int oldBlocks = (dir->size + BLOCKSIZE - 1) / BLOCKSIZE;
+    int newBlocks = (next * (int)sizeof(struct dir_entry) + BLOCKSIZE - 1) / BLOCKSIZE;
+    int n;
+    for (n = newBlocks; n < oldBlocks; n++) {
+        dir = getInode(dirInodeNum);
+        blockNum = getNthBlock(dir, dirInodeNum, n, false);
+        // a block that cannot be unmapped stays with the directory
+        if (blockNum > 0 && blockNum < numBlocks && setNthBlock(dir, n, 0) == 0) {
+            markBlockFree(blockNum);
+        }
+    }
+    dir = getInode(dirInodeNum);
+    if (newBlocks <= NUM_DIRECT && dir->indirect != 0) {
+        markBlockFree(dir->indirect);
+        dir->indirect = 0;
+    }
+    dir->size = next * sizeof(struct dir_entry);
+    saveInode(dirInodeNum);
+    
+    // the entries that moved are somewhere else now
+    dcache_remove_dir(nameCache, dirInodeNum);
+    forgetFreeSlots(dirInodeNum);
+    if (indexInodeNum != 0) {
+        int numSlots = INDEX_SLOTS_PER_BLOCK;
+        while (numSlots < 4 * next) {
+            numSlots *= 2;
+        }
+        if (fillDirectoryIndex(dirInodeNum, indexInodeNum, numSlots) == ERROR) {
+            dropDirectoryIndex(dirInodeNum);
+        }
+    }
+    TracePrintf(1, "compacted directory %d from %d to %d entries, freeing %d blocks\n",
+        dirInodeNum, numEntries, next, oldBlocks - newBlocks);
+    return oldBlocks - newBlocks;
 }
 
-void
-clearFile(struct inode *inode, int inodeNum) {
-    int i = 0;
-    int blockNum;
-    while ((blockNum = getNthBlock(inode, i++, false)) != 0) {
-        addFreeBlockToList(blockNum);
+/*
+ * Compacts the directory if it is big enough, more than COMPACT_FREE_PERCENT
+ * percent of its entries are free and compacting it would free a block
+ */
+static void
+compactDirectoryIfSparse(int dirInodeNum) {
+    int size = getInode(dirInodeNum)->size;
+    int numEntries = size / sizeof(struct dir_entry);
+    if (numEntries < COMPACT_MIN_ENTRIES) {
+        return;
+    }
+    struct dirFreeSlots *slots = getFreeSlots(dirInodeNum);
+    int numFree = 0;
+    int n;
+    for (n = 0; n < slots->numBlocks; n++) {
+        numFree += slots->freeEntries[n];
+    }
+    int liveBlocks = ((numEntries - numFree) * (int)sizeof(struct dir_entry) 
+        + BLOCKSIZE - 1) / BLOCKSIZE;
+    if (numFree * 100 > numEntries * COMPACT_FREE_PERCENT 
+            && liveBlocks < (size + BLOCKSIZE - 1) / BLOCKSIZE) {
+        compactDirectory(dirInodeNum);
     }
-    inode->size = 0;
-    saveInode(inodeNum);
 }
 
 /*
- * Returns offset within blocknum block
+ * Returns offset within blocknum block. Names looked up without creating
+ * them are remembered in the name cache, whether they were found or not, so
+ * looking them up again does not scan the directory.
  */
 int
 getDirectoryEntry(char *pathname, int inodeStartNumber, int *blockNumPtr, bool createIfNeeded) {
+    dcache_entry *cached = dcache_lookup(nameCache, inodeStartNumber, pathname);
+    if (cached != NULL && cached->inum != 0) {
+        *blockNumPtr = cached->block;
+        return cached->offset;
+    }
+    if (cached != NULL && !createIfNeeded) {
+        *blockNumPtr = 0;
+        return -1;
+    }
+    
+    // large directories are searched through their index, which is built
+    // once a directory reaches DIR_INDEX_THRESHOLD entries
+    int indexInodeNum = getDirectoryIndex(inodeStartNumber);
+    if (indexInodeNum == 0 && createIfNeeded && getInode(inodeStartNumber)->size
+            >= DIR_INDEX_THRESHOLD * (int)sizeof(struct dir_entry)) {
+        indexInodeNum = buildDirectoryIndex(inodeStartNumber);
+    }
+    if (indexInodeNum != 0) {
+        return getIndexedDirectoryEntry(pathname, inodeStartNumber, indexInodeNum,
+            blockNumPtr, createIfNeeded);
+    }
+    
+    // a name known not to be in the directory goes straight into a free
+    // entry, without scanning for the name or for the entry
+    if (cached != NULL) {
+        dcache_remove(nameCache, inodeStartNumber, pathname);
+        int entryNum = takeFreeSlot(inodeStartNumber);
+        if (entryNum == -1) {
+            entryNum = appendDirectoryEntry(inodeStartNumber);
+        }
+        if (entryNum == -1) {
+            return -1;
+        }
+        return getEntryLocation(inodeStartNumber, entryNum, blockNumPtr);
+    }
+    
     int freeEntryOffset = -1;
     int freeEntryBlockNum = 0;
     void * currentBlock;
     struct dir_entry *currentEntry;
     struct inode *inode = getInode(inodeStartNumber);
     int i = 0;
-    int blockNum = getNthBlock(inode, i, false);
-    int currBlockNum = 0;
+    int blockNum = getNthBlock(inode, inodeStartNumber, i, false);
     int totalSize = sizeof (struct dir_entry);
     bool isFound = false;
     while (blockNum != 0 && !isFound) {
-        currentBlock = getBlock(blockNum);
+        currentBlock = getMetadataBlock(blockNum);
+        if (currentBlock == NULL) {
+            // every frame is pinned; the name may still be there
+            *blockNumPtr = 0;
+            return -1;
+        }
         currentEntry = (struct dir_entry *) currentBlock;
         while (totalSize <= inode->size 
                 && ((char *) currentEntry < ((char *) currentBlock + BLOCKSIZE))) 
@@ -558,9 +2517,10 @@ getDirectoryEntry(char *pathname, int inodeStartNumber, int *blockNumPtr, bool c
                 freeEntryOffset = (int)((char *)currentEntry - (char *)currentBlock);
             }
             
-            //check the currentEntry fileName to see if it matches
+            //check the currentEntry fileName to see if it matches; a freed
+            // entry keeps its name, but does not count
             TracePrintf(1, "current entry->name - %s\n", currentEntry->name);
-            if (isEqual(pathname, currentEntry->name)) {
+            if (currentEntry->inum != 0 && isEqual(pathname, currentEntry->name)) {
                 isFound = true;
                 break;
             }
@@ -572,94 +2532,49 @@ getDirectoryEntry(char *pathname, int inodeStartNumber, int *blockNumPtr, bool c
         if (isFound) {
             break;
         }
-        currBlockNum = blockNum;
-        blockNum = getNthBlock(inode, ++i, false);
+        blockNum = getNthBlock(inode, inodeStartNumber, ++i, false);
     }
     *blockNumPtr = blockNum;
 
     if (isFound) {
         int offset = (int)((char *)currentEntry - (char *)currentBlock);
+        if (createIfNeeded) {
+            dcache_remove(nameCache, inodeStartNumber, pathname);
+        } else {
+            dcache_insert(nameCache, inodeStartNumber, pathname,
+                currentEntry->inum, blockNum, offset);
+        }
         return offset;
     } 
     if (createIfNeeded) {
+        // the caller is about to fill in the name, so it is no longer
+        // known to be missing
+        dcache_remove(nameCache, inodeStartNumber, pathname);
         if (freeEntryBlockNum != 0) {
+            noteFreeSlot(inodeStartNumber, freeEntryBlockNum, -1);
             *blockNumPtr = freeEntryBlockNum;
             return freeEntryOffset;
         }
-        if (inode->size % BLOCKSIZE == 0) {
-            // we're at the bottom edge of the block, so
-            // we need to allocate a new block
-            blockNum = getNthBlock(inode, i, true);
-            currentBlock = getBlock(blockNum);
-            inode->size += sizeof(struct dir_entry);
-            struct dir_entry * newEntry = (struct dir_entry *) currentBlock;
-            newEntry->inum = 0;
-            saveBlock(blockNum);
-            saveInode(inodeStartNumber);
-            *blockNumPtr = blockNum;
-            return 0;
-        } 
-        inode->size += sizeof(struct dir_entry);
-        saveInode(inodeStartNumber);
-        currentEntry->inum = 0;
-        saveBlock(currBlockNum);
-        *blockNumPtr = currBlockNum;
-        int offset = (int)((char *)currentEntry - (char *)currentBlock);
-        return offset;
-    }
-    return -1;
-}
-
-int
-getContainingDirectory(char *pathname, int currentInode, char **filenamePtr) {
-        // error checking
-    int i;
-    for (i = 0; i < MAXPATHNAMELEN; i++) {
-        if (pathname[i] == '\0') {
-            break;
-        }
-    }
-    if (i == MAXPATHNAMELEN) {
-        return ERROR;
-    }
-    
-    // adjust pathname
-    if (pathname[0] == '/') {
-        while (pathname[0] == '/')
-            pathname += sizeof(char);
-        currentInode = ROOTINODE;
-    }
-    
-    // Truncate the pathname to NOT include the name of the file to create
-    int lastSlashIndex = 0;
-    i = 0;
-    while ((pathname[i] != '\0') && (i < MAXPATHNAMELEN)) {
-        if (pathname[i] == '/') {
-            lastSlashIndex = i;
+        int entryNum = appendDirectoryEntry(inodeStartNumber);
+        if (entryNum == -1) {
+            return -1;
         }
-        i++;
+        return getEntryLocation(inodeStartNumber, entryNum, blockNumPtr);
     }
-    
-    if (lastSlashIndex != 0) {
-        char path[lastSlashIndex + 1];
-        for (i = 0; i < lastSlashIndex; i++) {
-            path[i] = pathname[i];
-        }
-        path[i] = '\0';
+    dcache_insert(nameCache, inodeStartNumber, pathname, 0, 0, 0);
+    return -1;
+}
 
-        char *filename = pathname + (sizeof(char) * (lastSlashIndex + 1));
-        *filenamePtr = filename;
-        // Get the inode of the directory the file should be created in
-        numSymLinks = 0;
-        int dirInodeNum = getInodeNumberForPath(path, currentInode);
-        if (dirInodeNum == 0) {
-            return ERROR;
-        }
-        return dirInodeNum;
-    } else {
-        
-        *filenamePtr = pathname;
-        return currentInode;
+/*
+ * Sets the name of the directory entry to the path component name, which
+ * ends at a '/', at a NUL or after DIRNAMELEN characters
+ */
+static void
+setEntryName(struct dir_entry *entry, char *name) {
+    int i;
+    memset(entry->name, '\0', DIRNAMELEN);
+    for (i = 0; i < DIRNAMELEN && name[i] != '\0' && name[i] != '/'; i++) {
+        entry->name[i] = name[i];
     }
 }
 
@@ -668,13 +2583,8 @@ yfsOpen(char *pathname, int currentInode) {
     if (pathname == NULL || currentInode <= 0) {
         return ERROR;
     }
-    if (pathname[0] == '/') {
-        while (pathname[0] == '/')
-            pathname += sizeof(char);
-         currentInode = ROOTINODE;
-    }
-    numSymLinks = 0;
-    int inodenum = getInodeNumberForPath(pathname, currentInode);
+    struct pathLookup lookup;
+    int inodenum = lookupPath(pathname, currentInode, true, &lookup);
     if (inodenum == 0) {
         return ERROR;
     }
@@ -706,24 +2616,28 @@ yfsCreate(char *pathname, int currentInode, int inodeNumToSet) {
         i++;
     }
     TracePrintf(1, "Creating %s in %d\n", pathname, currentInode);
-    char *filename;
-    int dirInodeNum = getContainingDirectory(pathname, currentInode, &filename);
+    struct pathLookup lookup;
+    lookupPath(pathname, currentInode, false, &lookup);
+    int dirInodeNum = lookup.dirInodeNum;
+    char *filename = lookup.name;
     TracePrintf(1, "containind dirInodenum = %d\n", dirInodeNum);
-    if (dirInodeNum == ERROR) {
+    if (dirInodeNum == 0) {
         return ERROR;
     }
     
-    struct inode *dirInode = getInode(dirInodeNum);
-    
-    if (dirInode->type != INODE_DIRECTORY) {
-        return ERROR;
+    // the lookup found the entry if the file exists; otherwise search the
+    // directory for a free entry
+    int blockNum = lookup.blockNum;
+    int offset = lookup.offset;
+    if (lookup.inodeNum == 0) {
+        TracePrintf(1, "getting directory entry: %s in inode %d\n", filename, dirInodeNum);
+        offset = getDirectoryEntry(filename, dirInodeNum, &blockNum, true);
     }
-    // Search all directory entries of that inode for the file name to create
-    int blockNum;
-    TracePrintf(1, "getting directory entry: %s in inode %d\n", filename, dirInodeNum);
-    int offset = getDirectoryEntry(filename, dirInodeNum, &blockNum, true);
     TracePrintf(1, "offset = %d, blockNum = %d\n", offset, blockNum);
-    void *block = getBlock(blockNum);
+    if (offset == -1) {
+        return ERROR;
+    }
+    void *block = getMetadataBlock(blockNum);
         
     struct dir_entry *dir_entry = (struct dir_entry *) ((char *)block + offset);
     // If the file exists, get the inode, set its size to zero, and return
@@ -735,6 +2649,10 @@ yfsCreate(char *pathname, int currentInode, int inodeNumToSet) {
         }
         int inodeNum = dir_entry->inum;
         struct inode *inode = getInode(inodeNum);
+        // a directory cannot be truncated like a file
+        if (inode->type == INODE_DIRECTORY) {
+            return ERROR;
+        }
         clearFile(inode, inodeNum);
         
         // TODO have method to calculate block number?
@@ -742,35 +2660,94 @@ yfsCreate(char *pathname, int currentInode, int inodeNumToSet) {
         return inodeNum;
     }
     
+    // the entry is filled in around getting a new inode, which may evict
+    // blocks, so pin its block until it is done
+    pinBlock(blockNum);
+    
     // If the file does not exist, find the first free directory entry, get
     // a new inode number from free list, get that inode, change the info on 
     // that inode and directory entry (name, type), then return the inode number
-    for (i = 0; i<DIRNAMELEN; i++) {
-        dir_entry->name[i] = '\0';
-    }
-    for (i = 0; filename[i] != '\0'; i++) {
-        dir_entry->name[i] = filename[i];
-    }
+    setEntryName(dir_entry, filename);
     TracePrintf(1, "new directory entry name: %s\n", dir_entry->name);
     if (inodeNumToSet == CREATE_NEW) {
         TracePrintf(1, "Creating new!\n");
-        inodeNum = getNextFreeInodeNum();
+        inodeNum = getNextFreeInodeNum(dirInodeNum);
         TracePrintf(1, "new inodeNum = %d\n", inodeNum);
         dir_entry->inum = inodeNum;
         saveBlock(blockNum);
+        unpinBlock(blockNum);
+        if (inodeNum == 0) {
+            return ERROR;
+        }
         struct inode *inode = getInode(inodeNum);
         inode->type = INODE_REGULAR;
         inode->size = 0;
         inode->nlink = 1;
         saveInode(inodeNum);
+        // put the file's data next to its directory
+        blockGoals[inodeNum] = blockNum;
         return inodeNum;
     } else {
         dir_entry->inum = inodeNumToSet;
         saveBlock(blockNum);
+        unpinBlock(blockNum);
         return inodeNumToSet;
     }
 }
 
+/*
+ * Called after each read of the inode. A read that starts where the last
+ * one ended grows the readahead window (doubling it up to MAX_READAHEAD,
+ * and never past half of the data partition, so read-ahead blocks are not
+ * evicted before they are used), and any other read collapses it. Then
+ * the blocks within the window after this read are brought into the cache.
+ */
+void
+readAhead(struct inode *inode, int inodeNum, int byteOffset, int bytesRead) {
+    struct readahead *ra = &readaheads[inodeNum % READAHEAD_SLOTS];
+    if (ra->inodeNum != inodeNum) {
+        ra->inodeNum = inodeNum;
+        ra->nextOffset = 0;
+        ra->window = 0;
+        ra->nextBlock = 0;
+    }
+    
+    int maxWindow = partitions[DATA_PARTITION].budget / 2;
+    if (maxWindow > MAX_READAHEAD) {
+        maxWindow = MAX_READAHEAD;
+    }
+    if (byteOffset == ra->nextOffset && bytesRead > 0) {
+        ra->window = ra->window == 0 ? MIN_READAHEAD : ra->window * 2;
+        if (ra->window > maxWindow) {
+            ra->window = maxWindow;
+        }
+    } else {
+        ra->window = 0;
+        ra->nextBlock = 0;
+    }
+    ra->nextOffset = byteOffset + bytesRead;
+    if (ra->window == 0) {
+        return;
+    }
+    
+    // read ahead the blocks after the last one this read touched, up to the
+    // end of the window or of the file
+    int n = (ra->nextOffset + BLOCKSIZE - 1) / BLOCKSIZE;
+    if (n < ra->nextBlock) {
+        n = ra->nextBlock;
+    }
+    int lastBlock = (ra->nextOffset - 1) / BLOCKSIZE + ra->window;
+    for (; n <= lastBlock && n * BLOCKSIZE < inode->size; n++) {
+        // holes and preallocated blocks are not read, so there is
+        // nothing to fetch for them
+        int blockNum = getNthBlock(inode, inodeNum, n, false);
+        if (blockNum > 0) {
+            prefetchBlock(blockNum);
+        }
+    }
+    ra->nextBlock = n;
+}
+
 int
 yfsRead(int inodeNum, void *buf, int size, int byteOffset, int pid) {
     if (buf == NULL || size < 0 || byteOffset < 0 || inodeNum <= 0) {
@@ -778,8 +2755,9 @@ yfsRead(int inodeNum, void *buf, int size, int byteOffset, int pid) {
     }
     struct inode *inode = getInode(inodeNum);
     
-    if (byteOffset > inode->size) {
-        return ERROR;
+    // there is nothing to read past the end of the file
+    if (byteOffset >= inode->size) {
+        return 0;
     }
     
     int bytesLeft = size;
@@ -795,11 +2773,13 @@ yfsRead(int inodeNum, void *buf, int size, int byteOffset, int pid) {
     
     int i;
     for (i = byteOffset / BLOCKSIZE; bytesLeft > 0; i++) {
-        int blockNum = getNthBlock(inode, i, false);
-        if (blockNum == 0) {
+        // holes and preallocated blocks that were never written are all
+        // zeros
+        int blockNum = getNthBlock(inode, inodeNum, i, false);
+        void *currentBlock = blockNum <= 0 ? zeroBlock : getBlock(blockNum);
+        if (currentBlock == NULL) {
             return ERROR;
         }
-        void *currentBlock = getBlock(blockNum);
         
         if (bytesLeft < bytesToCopy) {
             bytesToCopy = bytesLeft;
@@ -817,12 +2797,15 @@ yfsRead(int inodeNum, void *buf, int size, int byteOffset, int pid) {
         bytesToCopy = BLOCKSIZE;
     }
     
+    readAhead(inode, inodeNum, byteOffset, returnVal);
     return returnVal;
 }
 
 int 
 yfsWrite(int inodeNum, void *buf, int size, int byteOffset, int pid) {
-    
+    if (buf == NULL || size < 0 || byteOffset < 0 || inodeNum <= 0) {
+        return ERROR;
+    }
     struct inode *inode = getInode(inodeNum);
     if (inode->type != INODE_REGULAR) {
         return ERROR;
@@ -838,16 +2821,47 @@ yfsWrite(int inodeNum, void *buf, int size, int byteOffset, int pid) {
     
     int i;
     for (i = byteOffset / BLOCKSIZE; bytesLeft > 0; i++) {
-        int blockNum = getNthBlock(inode, i, true);
+        int blockNum = getNthBlock(inode, inodeNum, i, false);
+        // a block the file does not have yet, or a preallocated one that
+        // was never written, has nothing on disk worth reading
+        bool fresh = blockNum <= 0;
+        if (blockNum == 0 && delayedAllocation) {
+            // make room by allocating the delayed blocks there are, which
+            // may evict this inode from the inode cache
+            if (numDelayedBlocks >= maxDelayedBlocks()) {
+                saveInode(inodeNum);
+                flushDelayedBlocks();
+                inode = getInode(inodeNum);
+            }
+            blockNum = createDelayedBlock(inode, inodeNum, i);
+        } else if (blockNum == 0) {
+            blockNum = getNthBlock(inode, inodeNum, i, true);
+        }
         if (blockNum == 0) {
             return ERROR;
         }
-        void *currentBlock = getBlock(blockNum);
+        if (blockNum < 0) {
+            blockNum = -blockNum;
+            if (setNthBlock(inode, i, blockNum) == ERROR) {
+                return ERROR;
+            }
+        }
         
         if (bytesLeft < bytesToCopy) {
             bytesToCopy = bytesLeft;
         }
         
+        // neither is a block that is about to be overwritten completely
+        void *currentBlock;
+        if (fresh || bytesToCopy == BLOCKSIZE) {
+            currentBlock = getBlockForOverwrite(blockNum);
+        } else {
+            currentBlock = getBlock(blockNum);
+        }
+        if (currentBlock == NULL) {
+            return ERROR;
+        }
+        
         if (CopyFrom(pid, (char *)currentBlock + blockOffset, buf, bytesToCopy) == ERROR)
         {
             TracePrintf(1, "error copying %d bytes from pid %d\n", bytesToCopy, pid);
@@ -869,29 +2883,111 @@ yfsWrite(int inodeNum, void *buf, int size, int byteOffset, int pid) {
     return returnVal;
 }
 
+/*
+ * Allocates the blocks of the file from offset to offset + len that it does
+ * not have yet, as one contiguous run if there is a free one that long. The
+ * new blocks are marked unwritten, so they read as zeros until they are
+ * written, and the file grows to at least offset + len bytes. On a disk
+ * whose format has no unwritten blocks, the new blocks are zeroed instead.
+ */
+int
+yfsFallocate(int inodeNum, int offset, int len) {
+    if (inodeNum <= 0 || offset < 0 || len <= 0 
+            || len > MAX_FILE_BLOCKS * BLOCKSIZE - offset) {
+        return ERROR;
+    }
+    struct inode *inode = getInode(inodeNum);
+    if (inode->type != INODE_REGULAR) {
+        return ERROR;
+    }
+    // blocks written in delayed allocation mode get their blocks first
+    if (numDelayedBlocks > 0) {
+        flushDelayedBlocks();
+        inode = getInode(inodeNum);
+    }
+    
+    // count the blocks to allocate
+    int first = offset / BLOCKSIZE;
+    int last = (offset + len - 1) / BLOCKSIZE;
+    int needed = 0;
+    int n;
+    for (n = first; n <= last; n++) {
+        if (getMappedBlock(inode, inodeNum, n, false) == 0) {
+            needed++;
+        }
+    }
+    if (needed > 0 && last >= NUM_DIRECT && inode->indirect == 0) {
+        needed++;
+    }
+    if (freeBlockCount - reservedBlockCount < needed) {
+        return ERROR;
+    }
+    
+    // look for a run that holds them all, from where the file would put
+    // its first one
+    int goal = getBlockGoal(inode, inodeNum, first);
+    int next = needed > 0 ? bitmap_find_clear_run(blockBitmap, numBlocks, goal, needed) : -1;
+    if (next == -1) {
+        next = goal;
+    }
+    for (n = first; n <= last; n++) {
+        if (getMappedBlock(inode, inodeNum, n, false) != 0) {
+            continue;
+        }
+        // the blocks allocated so far stay with the file if the cache has
+        // no frame for a block map update
+        if (n >= NUM_DIRECT && inode->indirect == 0) {
+            inode->indirect = allocateBlockNear(next);
+            if (getMetadataBlockForOverwrite(inode->indirect) == NULL) {
+                markBlockFree(inode->indirect);
+                inode->indirect = 0;
+                saveInode(inodeNum);
+                return ERROR;
+            }
+            next = inode->indirect + 1;
+        }
+        int blockNum = allocateBlockNear(next);
+        if (setNthBlock(inode, n, unwrittenOnDisk ? -blockNum : blockNum) == ERROR) {
+            markBlockFree(blockNum);
+            saveInode(inodeNum);
+            return ERROR;
+        }
+        if (!unwrittenOnDisk) {
+            // an uncached block has no stale copy in the cache, so it can
+            // be zeroed on the disk directly
+            if (getBlockForOverwrite(blockNum) == NULL) {
+                WriteSector(blockNum, zeroBlock);
+            }
+        }
+        next = blockNum + 1;
+    }
+    if (offset + len > inode->size) {
+        inode->size = offset + len;
+    }
+    saveInode(inodeNum);
+    return 0;
+}
+
 int
 yfsLink(char *oldName, char *newName, int currentInode) {
     if (oldName == NULL || newName == NULL || currentInode <= 0) {
         return ERROR;
     }
-    if (oldName[0] == '/') {
-        oldName += sizeof(char);
-        currentInode = ROOTINODE;
+    struct pathLookup lookup;
+    int oldNameNodeNum = lookupPath(oldName, currentInode, true, &lookup);
+    if (oldNameNodeNum == 0) {
+        return ERROR;
     }
-    numSymLinks = 0;
-    int oldNameNodeNum = getInodeNumberForPath(oldName, currentInode);
     struct inode *inode = getInode(oldNameNodeNum);
-    if (inode->type == INODE_DIRECTORY || oldNameNodeNum == 0) {
+    if (inode->type == INODE_DIRECTORY) {
         return ERROR;
     }
     
-    if (newName[0] == '/') {
-        newName += sizeof(char);
-        currentInode = ROOTINODE;
-    }
     if (yfsCreate(newName, currentInode, oldNameNodeNum) == ERROR) {
         return ERROR;
     }
+    // creating the name may have evicted the inode, so get it again
+    inode = getInode(oldNameNodeNum);
     inode->nlink++;
     saveInode(oldNameNodeNum);
     
@@ -904,21 +3000,31 @@ yfsUnlink(char *pathname, int currentInode) {
         return ERROR;
     }
     
-    // Get the containind directory 
-    char *filename;
-    int dirInodeNum = getContainingDirectory(pathname, currentInode, &filename);
-    
-    struct inode *dirInode = getInode(dirInodeNum);
-    if (dirInode->type != INODE_DIRECTORY) {
+    // Get the containing directory and the entry in it; a symlink is
+    // removed itself, not the file it names
+    struct pathLookup lookup;
+    lookupPath(pathname, currentInode, false, &lookup);
+    if (lookup.inodeNum == 0 || lookup.dirInodeNum == 0 || lookup.name == NULL) {
         return ERROR;
     }
-
-    int blockNum;
-    int offset = getDirectoryEntry(filename, dirInodeNum, &blockNum, false);
-    if (offset == -1) {
+    // directories, and "." and ".." with them, are only removed by RmDir
+    if (isEqual(lookup.name, ".") || isEqual(lookup.name, "..")) {
+        return ERROR;
+    }
+    struct inode *target = getInode(lookup.inodeNum);
+    if (target == NULL || target->type == INODE_DIRECTORY) {
+        return ERROR;
+    }
+    int dirInodeNum = lookup.dirInodeNum;
+    char *filename = lookup.name;
+    int blockNum = lookup.blockNum;
+    int offset = lookup.offset;
+    void *block = getMetadataBlock(blockNum);
+    if (block == NULL) {
         return ERROR;
     }
-    void *block = getBlock(blockNum);
+    // keep the entry's block cached while the file is released
+    pinBlock(blockNum);
 
     // Get the directory entry associated with the path
     struct dir_entry *dir_entry = (struct dir_entry *) ((char *)block + offset);
@@ -926,24 +3032,53 @@ yfsUnlink(char *pathname, int currentInode) {
     // Get the inode associated with the directory entry
     int inodeNum = dir_entry->inum;
     struct inode *inode = getInode(inodeNum);
+    if (inode == NULL) {
+        unpinBlock(blockNum);
+        return ERROR;
+    }
     
     // Decrease nlinks by 1
     inode->nlink--;
     
-    // If nlinks == 0, clear the file
-    if (inode->nlink == 0) {
+    // If nlinks == 0, clear the file and free its inode
+    bool freeInode = inode->nlink == 0;
+    if (freeInode) {
         clearFile(inode, inodeNum);
     } 
     
     saveInode(inodeNum);
+    if (freeInode) {
+        freeUpInode(inodeNum);
+    }
     
     // Set the inum to zero
     dir_entry->inum = 0;
     saveBlock(blockNum);
+    unpinBlock(blockNum);
+    dcache_remove(nameCache, dirInodeNum, filename);
+    noteFreeSlot(dirInodeNum, blockNum, 1);
+    compactDirectoryIfSparse(dirInodeNum);
     
     return 0;
 }
 
+/*
+ * Undoes a new directory entry, still pinned, whose inode could not be set
+ * up because there was no block for it: the entry is freed again along
+ * with its inode. Returns ERROR.
+ */
+static int
+abandonNewEntry(int dirInodeNum, char *name, int blockNum, 
+        struct dir_entry *entry, int inodeNum) {
+    entry->inum = 0;
+    saveBlock(blockNum);
+    unpinBlock(blockNum);
+    dcache_remove(nameCache, dirInodeNum, name);
+    noteFreeSlot(dirInodeNum, blockNum, 1);
+    freeUpInode(inodeNum);
+    return ERROR;
+}
+
 int
 yfsSymLink(char *oldname, char *newname, int currentInode) {
     
@@ -975,34 +3110,56 @@ yfsSymLink(char *oldname, char *newname, int currentInode) {
     }
     
     // create a directory for newname
-    char *filename;
-    int dirInodeNum = getContainingDirectory(newname, currentInode, &filename);
+    struct pathLookup lookup;
+    lookupPath(newname, currentInode, false, &lookup);
+    int dirInodeNum = lookup.dirInodeNum;
+    char *filename = lookup.name;
+    if (dirInodeNum == 0 || lookup.inodeNum != 0) {
+        return ERROR;
+    }
     // Search all directory entries of that inode for the file name to create
     int blockNum;
     int offset = getDirectoryEntry(filename, dirInodeNum, &blockNum, true);
-    void *block = getBlock(blockNum);
+    if (offset == -1) {
+        return ERROR;
+    }
+    void *block = getMetadataBlock(blockNum);
     
     struct dir_entry *dir_entry = (struct dir_entry *) ((char *)block + offset);
+    if (dir_entry->inum != 0) {
+        return ERROR;
+    }
     
-    // link that inode to newname
-    int inodeNum = getNextFreeInodeNum();
+    // link that inode to newname; getting the inode and its block may
+    // evict blocks, so the entry's block stays pinned until both are set up
+    pinBlock(blockNum);
+    int inodeNum = getNextFreeInodeNum(dirInodeNum);
     dir_entry->inum = inodeNum;
-    memset(dir_entry->name, '\0', DIRNAMELEN);
-
-    for (i = 0; filename[i] != '\0'; i++) {
-        dir_entry->name[i] = filename[i];
-    };
+    setEntryName(dir_entry, filename);
     saveBlock(blockNum);
+    if (inodeNum == 0) {
+        unpinBlock(blockNum);
+        return ERROR;
+    }
+    
+    // the rest of the block stays zero, so the name is NUL terminated
+    int dataBlockNum = allocateBlockNear(blockNum);
+    if (dataBlockNum == 0) {
+        return abandonNewEntry(dirInodeNum, filename, blockNum, dir_entry, inodeNum);
+    }
+    void *dataBlock = getMetadataBlockForOverwrite(dataBlockNum);
+    if (dataBlock == NULL) {
+        markBlockFree(dataBlockNum);
+        return abandonNewEntry(dirInodeNum, filename, blockNum, dir_entry, inodeNum);
+    }
+    memcpy(dataBlock, oldname, strlen(oldname));
+    unpinBlock(blockNum);
+    
     struct inode *inode = getInode(inodeNum);
     inode->type = INODE_SYMLINK;
     inode->size = sizeof(char) * strlen(oldname);
     inode->nlink = 1;
-    inode->direct[0] = getNextFreeBlockNum();
-    
-    void *dataBlock = getBlock(inode->direct[0]);
-    memcpy(dataBlock, oldname, strlen(oldname));
-    
-    saveBlock(inode->direct[0]);
+    inode->direct[0] = dataBlockNum;
     saveInode(inodeNum);
     return 0;
 }
@@ -1014,20 +3171,19 @@ yfsReadLink(char *pathname, char *buf, int len, int currentInode, int pid) {
     }
     TracePrintf(1, "read link for %s, len %d, at inode %d, from pid %d\n",
         pathname, len, currentInode, pid);
-    if (pathname[0] == '/') {
-        while (pathname[0] == '/')
-            pathname += sizeof(char);
-         currentInode = ROOTINODE;
-    }
-    numSymLinks = 0;
-    int symInodeNum = getInodeNumberForPath(pathname, currentInode);
-    if (symInodeNum == ERROR) {
+    // the link itself is read, not followed
+    struct pathLookup lookup;
+    int symInodeNum = lookupPath(pathname, currentInode, false, &lookup);
+    if (symInodeNum == 0) {
         return ERROR;
     }
     struct inode *symInode = getInode(symInodeNum);
+    if (symInode->type != INODE_SYMLINK) {
+        return ERROR;
+    }
     
     int dataBlockNum = symInode->direct[0];
-    char *dataBlock = (char *)getBlock(dataBlockNum);
+    char *dataBlock = (char *)getMetadataBlock(dataBlockNum);
     TracePrintf(1, "data block has string -> %s\n", dataBlock);
     
     int charsToRead = 0;
@@ -1051,17 +3207,21 @@ yfsMkDir(char *pathname, int currentInode) {
     if (pathname == NULL || currentInode <= 0) {
         return ERROR;
     }
-    if (pathname[0] == '/') {
-        while (pathname[0] == '/')
-            pathname += sizeof(char);
-         currentInode = ROOTINODE;
+    struct pathLookup lookup;
+    lookupPath(pathname, currentInode, false, &lookup);
+    int dirInodeNum = lookup.dirInodeNum;
+    char *filename = lookup.name;
+    // return error if this directory already exists
+    if (dirInodeNum == 0 || lookup.inodeNum != 0) {
+        return ERROR;
     }
-    char *filename;
-    int dirInodeNum = getContainingDirectory(pathname, currentInode, &filename);
     // Search all directory entries of that inode for the file name to create
     int blockNum;
     int offset = getDirectoryEntry(filename, dirInodeNum, &blockNum, true);
-    void *block = getBlock(blockNum);
+    if (offset == -1) {
+        return ERROR;
+    }
+    void *block = getMetadataBlock(blockNum);
     
     struct dir_entry *dir_entry = (struct dir_entry *) ((char *)block + offset);
     
@@ -1070,26 +3230,29 @@ yfsMkDir(char *pathname, int currentInode) {
         return ERROR;
     }
 
-    memset(&dir_entry->name, '\0', DIRNAMELEN);
-    int i;
-    for (i = 0; filename[i] != '\0'; i++) {
-        dir_entry->name[i] = filename[i];
-    }
+    // keep the entry's block cached while the new inode and its first
+    // block are allocated
+    pinBlock(blockNum);
+    setEntryName(dir_entry, filename);
     
-    int inodeNum = getNextFreeInodeNum();
+    int inodeNum = getNextFreeInodeNum(dirInodeNum);
     dir_entry->inum = inodeNum;
     saveBlock(blockNum);
-    block = getBlockForInode(inodeNum);
-    
-    struct inode *inode = getInode(inodeNum);
-    inode->type = INODE_DIRECTORY;
-    inode->size = 2 * sizeof (struct dir_entry);
-    inode->nlink = 1;
-    
-    int firstDirectBlockNum = getNextFreeBlockNum();
-    void *firstDirectBlock = getBlock(firstDirectBlockNum);
-    inode->direct[0] = firstDirectBlockNum;
+    if (inodeNum == 0) {
+        unpinBlock(blockNum);
+        return ERROR;
+    }
     
+    // "." and ".." are the only entries in a zeroed block
+    int firstDirectBlockNum = allocateBlockNear(blockNum);
+    if (firstDirectBlockNum == 0) {
+        return abandonNewEntry(dirInodeNum, filename, blockNum, dir_entry, inodeNum);
+    }
+    void *firstDirectBlock = getMetadataBlockForOverwrite(firstDirectBlockNum);
+    if (firstDirectBlock == NULL) {
+        markBlockFree(firstDirectBlockNum);
+        return abandonNewEntry(dirInodeNum, filename, blockNum, dir_entry, inodeNum);
+    }
     struct dir_entry *dir1 = (struct dir_entry *)firstDirectBlock;
     dir1->inum = inodeNum;
     dir1->name[0] = '.';
@@ -1098,9 +3261,13 @@ yfsMkDir(char *pathname, int currentInode) {
     dir2->inum = dirInodeNum;
     dir2->name[0] = '.';
     dir2->name[1] = '.';
+    unpinBlock(blockNum);
     
-    saveBlock(firstDirectBlockNum);
-    
+    struct inode *inode = getInode(inodeNum);
+    inode->type = INODE_DIRECTORY;
+    inode->size = 2 * sizeof (struct dir_entry);
+    inode->nlink = 1;
+    inode->direct[0] = firstDirectBlockNum;
     saveInode(inodeNum);
     return 0;
 }
@@ -1110,32 +3277,30 @@ yfsRmDir(char *pathname, int currentInode) {
     if (pathname == NULL || currentInode <= 0) {
         return ERROR;
     }
-    if (pathname[0] == '/') {
-        while (pathname[0] == '/')
-            pathname += sizeof(char);
-         currentInode = ROOTINODE;
+    struct pathLookup lookup;
+    int inodeNum = lookupPath(pathname, currentInode, false, &lookup);
+    // "/" and "" name a directory without naming an entry to remove
+    if (inodeNum == 0 || lookup.dirInodeNum == 0 || lookup.name == NULL) {
+        return ERROR;
     }
-    numSymLinks = 0;
-    int inodeNum = getInodeNumberForPath(pathname, currentInode);
-    if (inodeNum == ERROR) {
+    if (isEqual(lookup.name, ".") || isEqual(lookup.name, "..")) {
         return ERROR;
     }
     struct inode *inode = getInode(inodeNum);
     
-    if (inode->size > (int)(2*sizeof(struct dir_entry))) {
+    if (inode->type != INODE_DIRECTORY 
+            || inode->size > (int)(2*sizeof(struct dir_entry))) {
         return ERROR;
     }
     
     clearFile(inode, inodeNum);
-    addFreeInodeToList(inodeNum);
-    
+    freeUpInode(inodeNum);
     
-    char *filename;
-    int dirInodeNum = getContainingDirectory(pathname, currentInode, &filename);
-
-    int blockNum;
-    int offset = getDirectoryEntry(filename, dirInodeNum, &blockNum, true);
-    void *block = getBlock(blockNum);
+    int dirInodeNum = lookup.dirInodeNum;
+    char *filename = lookup.name;
+    int blockNum = lookup.blockNum;
+    int offset = lookup.offset;
+    void *block = getMetadataBlock(blockNum);
 
     // Get the directory entry associated with the path
     struct dir_entry *dir_entry = (struct dir_entry *) ((char *)block + offset);
@@ -1143,21 +3308,33 @@ yfsRmDir(char *pathname, int currentInode) {
     // Set the inum to zero
     dir_entry->inum = 0;
     saveBlock(blockNum);
+    dcache_remove(nameCache, dirInodeNum, filename);
+    noteFreeSlot(dirInodeNum, blockNum, 1);
+    compactDirectoryIfSparse(dirInodeNum);
     return 0;
 }
 
 int
-yfsChDir(char *pathname, int currentInode) {
+yfsCompact(char *pathname, int currentInode) {
     if (pathname == NULL || currentInode <= 0) {
         return ERROR;
     }
-    if (pathname[0] == '/') {
-        while (pathname[0] == '/')
-            pathname += sizeof(char);
-         currentInode = ROOTINODE;
+    struct pathLookup lookup;
+    int inodeNum = lookupPath(pathname, currentInode, true, &lookup);
+    if (inodeNum == 0 || getInode(inodeNum)->type != INODE_DIRECTORY) {
+        return ERROR;
+    }
+    compactDirectory(inodeNum);
+    return 0;
+}
+
+int
+yfsChDir(char *pathname, int currentInode) {
+    if (pathname == NULL || currentInode <= 0) {
+        return ERROR;
     }
-    numSymLinks = 0;
-    int inode = getInodeNumberForPath(pathname, currentInode);
+    struct pathLookup lookup;
+    int inode = lookupPath(pathname, currentInode, true, &lookup);
     if (inode == 0) {
         return ERROR;
     }
@@ -1169,13 +3346,8 @@ yfsStat(char *pathname, int currentInode, struct Stat *statbuf, int pid) {
     if (pathname == NULL || currentInode <= 0 || statbuf == NULL) {
         return ERROR;
     }
-    if (pathname[0] == '/') {
-        while (pathname[0] == '/')
-            pathname += sizeof(char);
-        currentInode = ROOTINODE;
-    }
-    numSymLinks = 0;
-    int inodeNum = getInodeNumberForPath(pathname, currentInode);
+    struct pathLookup lookup;
+    int inodeNum = lookupPath(pathname, currentInode, true, &lookup);
     if (inodeNum == 0) {
         return ERROR;
     }
@@ -1198,65 +3370,264 @@ yfsStat(char *pathname, int currentInode, struct Stat *statbuf, int pid) {
 int
 yfsSync(void) {
     TracePrintf(1, "About to sync all dirty blocks and inodes\n");
-    // First sync all dirty blocks
-    cacheItem *currBlockItem = cacheBlockQueue->firstItem;
-    while (currBlockItem != NULL) {
-        //TracePrintf(1, "currBlockItem->num = %d\n", currBlockItem->number);
-        if (currBlockItem->dirty) {
-            //write this block back to disk
-            WriteSector(currBlockItem->number, currBlockItem->addr);
-        }
-        currBlockItem = currBlockItem->nextItem;
-    }
+    // give the delayed blocks their block numbers before writing anything
+    flushDelayedBlocks();
     
-    // Now sync all dirty inodes
+    // First fold all dirty inodes into their inode table blocks, so that a
+    // block holding several dirty inodes is only written once; an inode
+    // that cannot be folded stays dirty, and the sync fails
+    int status = 0;
     cacheItem *currInodeItem = cacheInodeQueue->firstItem;
     while (currInodeItem != NULL) {
-        if (currInodeItem->dirty) {
-            int inodeNum = currInodeItem->number;
-            int blockNum = (inodeNum / INODESPERBLOCK) + 1;
-
-            void *block = getBlock(blockNum);
-            void *inodeAddrInBlock = (block + (inodeNum - (blockNum - 1) * INODESPERBLOCK) * INODESIZE);
-
-            memcpy(inodeAddrInBlock, currInodeItem->addr, sizeof(struct inode));
-            WriteSector(blockNum, block);
+        if (currInodeItem->dirty 
+                && foldInodeIntoBlock(currInodeItem->number, currInodeItem->addr) == ERROR) {
+            status = ERROR;
+        } else if (currInodeItem->dirty) {
+            currInodeItem->dirty = false;
+            inodeCacheStats.sync_writes++;
+            inodeCacheStats.writebacks++;
         }
         currInodeItem = currInodeItem->nextItem;
     }
+    
+    // Then write every dirty block exactly once, in ascending sector order
+    int numDirty = 0;
+    int i;
+    frameChunk *chunk;
+    for (chunk = frameChunks; chunk != NULL; chunk = chunk->next) {
+        for (i = 0; i < chunk->count; i++) {
+            cacheItem *currBlockItem = &chunk->frames[i].item;
+            // skip frames that do not hold a block, or hold a delayed
+            // block the flush could not allocate
+            if (!frameInUse(currBlockItem) || currBlockItem->number >= numBlocks) {
+                continue;
+            }
+            if (currBlockItem->dirty) {
+                dirtyBlocks[numDirty++] = currBlockItem;
+            }
+        }
+    }
+    qsort(dirtyBlocks, numDirty, sizeof(cacheItem *), compareBlockNumbers);
+    for (i = 0; i < numDirty; i++) {
+        // the bitmaps lie between the inode table and the data blocks
+        if (bitmapsOnDisk && dirtyBlocks[i]->number > diskHeader.inode_bitmap_start) {
+            writeBitmaps();
+        }
+        //write this block back to disk
+        WriteSector(dirtyBlocks[i]->number, dirtyBlocks[i]->addr);
+        dirtyBlocks[i]->dirty = false;
+        blockCacheStats.sync_writes++;
+        blockCacheStats.writebacks++;
+    }
+    writeBitmaps();
+    printCacheStats();
     TracePrintf(1, "Done syncing\n");
-    return 0;
+    return status;
  }
 
+int
+yfsStats(struct yfs_stats *statsbuf, int pid) {
+    if (statsbuf == NULL) {
+        return ERROR;
+    }
+    struct yfs_stats stats;
+    blockCacheStats.resizes = blockTable->resizes;
+    inodeCacheStats.resizes = inodeTable->resizes;
+    stats.block_cache = blockCacheStats;
+    stats.block_cache.capacity = blockCacheCapacity;
+    stats.inode_cache = inodeCacheStats;
+    stats.inode_cache.capacity = inodeCacheCapacity;
+    memset(&stats.name_cache, 0, sizeof(struct yfs_cache_stats));
+    stats.name_cache.capacity = nameCache->capacity;
+    stats.name_cache.lookups = nameCache->lookups;
+    stats.name_cache.hits = nameCache->hits;
+    stats.name_cache.misses = nameCache->misses;
+    stats.name_cache.evictions = nameCache->evictions;
+    stats.free_inodes = freeInodeCount;
+    stats.free_blocks = freeBlockCount - reservedBlockCount;
+    
+    if (CopyTo(pid, statsbuf, &stats, sizeof(struct yfs_stats)) == ERROR) {
+        TracePrintf(1, "error copying %d bytes to pid %d\n", sizeof(struct yfs_stats), pid);
+        return ERROR;
+    }
+    return 0;
+}
+
+/*
+ * Removes the frames of the chunk from a list of unused frames
+ */
+static cacheItem *
+removeChunkFrames(cacheItem *list, frameChunk *chunk) {
+    cacheItem *kept = NULL;
+    while (list != NULL) {
+        cacheItem *next = list->nextItem;
+        blockFrame *frame = (blockFrame *)list;
+        if (frame < chunk->frames || frame >= chunk->frames + chunk->count) {
+            list->nextItem = kept;
+            kept = list;
+        }
+        list = next;
+    }
+    return kept;
+}
+
+/*
+ * Frees the newest chunks of block frames while the rest still hold at
+ * least capacity frames, evicting the blocks cached in them. Stops at a
+ * chunk with a pinned block.
+ */
+static void
+freeFrameChunks(int capacity) {
+    while (frameChunks != NULL && numBlockFrames - frameChunks->count >= capacity) {
+        frameChunk *chunk = frameChunks;
+        int i;
+        for (i = 0; i < chunk->count; i++) {
+            if (frameInUse(&chunk->frames[i].item) && chunk->frames[i].item.pins > 0) {
+                return;
+            }
+        }
+        for (i = 0; i < chunk->count; i++) {
+            if (frameInUse(&chunk->frames[i].item)) {
+                dropFrame(&chunk->frames[i].item);
+            }
+        }
+        freeBlockFrames = removeChunkFrames(freeBlockFrames, chunk);
+        spareBlockFrames = removeChunkFrames(spareBlockFrames, chunk);
+        frameChunks = chunk->next;
+        numBlockFrames -= chunk->count;
+        free(chunk->frames);
+        free(chunk);
+    }
+}
+
+/*
+ * Changes the number of blocks the block cache may hold. Growing it adds
+ * free frames; shrinking it evicts blocks, writing back the dirty ones,
+ * until every partition is within its new budget, and frees the frames
+ * that are no longer needed.
+ */
+static int
+resizeBlockCache(int capacity) {
+    int i;
+    // delayed blocks are pinned, so they have to be allocated to be evicted
+    flushDelayedBlocks();
+    if (capacity > numBlockFrames
+            && addFrameChunk(capacity - numBlockFrames) == ERROR) {
+        TracePrintf(1, "error growing the block cache to %d blocks\n", capacity);
+        return ERROR;
+    }
+    blockCacheCapacity = capacity;
+    setPartitionBudgets();
+    for (i = 0; i < NUM_PARTITIONS; i++) {
+        blockPolicy->resize(partitions[i].policyState, partitions[i].budget);
+        while (partitions[i].size > partitions[i].budget) {
+            cacheItem *item = blockPolicy->evict(partitions[i].policyState);
+            if (item == NULL) {
+                break;
+            }
+            partitions[i].size--;
+            evictFrame(item);
+            blockCacheSize--;
+            item->nextItem = freeBlockFrames;
+            freeBlockFrames = item;
+        }
+    }
+    freeFrameChunks(capacity);
+    
+    // only capacity frames may be used, the rest of them are kept spare
+    while (spareBlockFrames != NULL) {
+        cacheItem *item = spareBlockFrames;
+        spareBlockFrames = item->nextItem;
+        item->nextItem = freeBlockFrames;
+        freeBlockFrames = item;
+    }
+    int usable = capacity - blockCacheSize;
+    cacheItem **link = &freeBlockFrames;
+    while (*link != NULL && usable > 0) {
+        link = &(*link)->nextItem;
+        usable--;
+    }
+    spareBlockFrames = *link;
+    *link = NULL;
+    
+    if (int_table_resize(blockTable, blockCacheSize > capacity ? blockCacheSize : capacity) == -1) {
+        TracePrintf(1, "error resizing the block cache table\n");
+    }
+    TracePrintf(1, "block cache now holds up to %d blocks in %d frames\n",
+        capacity, numBlockFrames);
+    return 0;
+}
+
+/*
+ * Changes the number of inodes the inode cache may hold, evicting the least
+ * recently used inodes if it holds more than that
+ */
+static int
+resizeInodeCache(int capacity) {
+    inodeCacheCapacity = capacity;
+    while (inodeCacheSize > inodeCacheCapacity) {
+        if (evictInode() == ERROR) {
+            return ERROR;
+        }
+    }
+    if (int_table_resize(inodeTable, capacity) == -1) {
+        TracePrintf(1, "error resizing the inode cache table\n");
+    }
+    TracePrintf(1, "inode cache now holds up to %d inodes\n", capacity);
+    return 0;
+}
+
+/*
+ * Resizes the caches; a size of 0 leaves that cache as it is
+ */
+int
+yfsResizeCaches(int blockCapacity, int inodeCapacity) {
+    if (blockCapacity < 0 || inodeCapacity < 0
+            || (blockCapacity != 0 && blockCapacity < MIN_BLOCK_CACHESIZE)
+            || (inodeCapacity != 0 && inodeCapacity < MIN_INODE_CACHESIZE)) {
+        return ERROR;
+    }
+    // shrink the inode cache first, as that may dirty blocks
+    if (inodeCapacity != 0 && resizeInodeCache(inodeCapacity) == ERROR) {
+        return ERROR;
+    }
+    if (blockCapacity != 0 && resizeBlockCache(blockCapacity) == ERROR) {
+        return ERROR;
+    }
+    return 0;
+}
+
 int
 yfsShutdown(void) {
     yfsSync();
+    // everything is on disk, so the next start can trust the bitmaps
+    setCleanFlag(1);
     TracePrintf(1, "About to shutdown the YFS file system server\n");
     Exit(0);
 }
 
 int
 yfsSeek(int inodeNum, int offset, int whence, int currentPosition) {
-    numSymLinks = 0;
     struct inode *inode = getInode(inodeNum);
     int size = inode->size;
-    if (currentPosition > size || currentPosition < 0) {
+    // seeking past the end of the file is fine, a write there leaves a hole
+    if (currentPosition < 0) {
         return ERROR;
     }
     if (whence == SEEK_SET) {
-        if (offset < 0 || offset > size) {
+        if (offset < 0) {
             return ERROR;
         }
         return offset;
     }
     if (whence == SEEK_CUR) {
-        if (currentPosition + offset > size || currentPosition + offset < 0) {
+        if (currentPosition + offset < 0) {
             return ERROR;
         }
         return currentPosition + offset;
     }
     if (whence == SEEK_END) {
-        if (offset > 0 || size + offset < 0) {
+        if (size + offset < 0) {
             return ERROR;
         }
         return size + offset;
@@ -1264,16 +3635,66 @@ yfsSeek(int inodeNum, int offset, int whence, int currentPosition) {
     return ERROR;
 }
 
+/*
+ * Handles the server options that come before the program to run:
+ *   -p policy    block cache replacement policy ("lru" or "2q")
+ *   -u           serve inodes in place from the block cache
+ *   -b blocks    number of blocks the block cache holds
+ *   -i inodes    number of inodes the inode cache holds
+ *   -d           allocate the blocks written to files only when flushing
+ * Returns the index in argv of the program to run
+ */
+int
+parseServerOptions(int argc, char **argv)
+{
+    int arg = 1;
+    while (arg < argc && argv[arg][0] == '-') {
+        if (strcmp(argv[arg], "-p") == 0 && arg + 1 < argc) {
+            blockPolicy = findCachePolicy(argv[arg + 1]);
+            if (blockPolicy == NULL) {
+                TracePrintf(1, "unknown cache policy %s\n", argv[arg + 1]);
+                Exit(1);
+            }
+            arg += 2;
+        } else if (strcmp(argv[arg], "-u") == 0) {
+            unifiedInodeCache = true;
+            arg++;
+        } else if (strcmp(argv[arg], "-d") == 0) {
+            delayedAllocation = true;
+            arg++;
+        } else if (strcmp(argv[arg], "-b") == 0 && arg + 1 < argc) {
+            blockCacheCapacity = atoi(argv[arg + 1]);
+            if (blockCacheCapacity < MIN_BLOCK_CACHESIZE) {
+                TracePrintf(1, "block cache must hold at least %d blocks\n",
+                    MIN_BLOCK_CACHESIZE);
+                Exit(1);
+            }
+            arg += 2;
+        } else if (strcmp(argv[arg], "-i") == 0 && arg + 1 < argc) {
+            inodeCacheCapacity = atoi(argv[arg + 1]);
+            if (inodeCacheCapacity < MIN_INODE_CACHESIZE) {
+                TracePrintf(1, "inode cache must hold at least %d inodes\n",
+                    MIN_INODE_CACHESIZE);
+                Exit(1);
+            }
+            arg += 2;
+        } else {
+            TracePrintf(1, "usage: yfs [-p lru|2q] [-u] [-d] [-b blocks] [-i inodes] [program args...]\n");
+            Exit(1);
+        }
+    }
+    return arg;
+}
+
 int
 main(int argc, char **argv)
 {
-    (void) argc;
-    (void) argv;
+    int arg = parseServerOptions(argc, argv);
     init();
 
-    if (argc > 1) {
+    if (argc > arg) {
         if (Fork() == 0) {
-            Exec(argv[1], argv + 1);
+            Exec(argv[arg], argv + arg);
         } else {
             for (;;) {
                 processRequest(); 
@@ -2,11 +2,46 @@
 #include <comp421/iolib.h>
 
 #define INODESPERBLOCK (BLOCKSIZE / INODESIZE)
+// the most blocks a file can have: the direct ones and the indirect ones
+#define MAX_FILE_BLOCKS (NUM_DIRECT + BLOCKSIZE / (int)sizeof(int))
 #define CREATE_NEW -1
 
-typedef struct freeInode freeInode;
-typedef struct freeBlock freeBlock;
+// the block cache partitions: file data, and inode table, directory,
+// indirect and symlink blocks
+#define DATA_PARTITION 0
+#define METADATA_PARTITION 1
+#define NUM_PARTITIONS 2
+
+// how many inode table blocks getInode() keeps pinned in unified mode; an
+// inode pointer stays valid until inodes in this many other blocks are used
+#define MAX_INODE_PINS 2
+
+// the most blocks a single request pins at once: the symlink targets of a
+// path being followed, the inode table blocks and a directory entry's block
+#define MAX_REQUEST_PINS (MAXSYMLINKS + MAX_INODE_PINS + 1)
+
+// the smallest caches the server can be configured with. Delayed blocks
+// may pin up to a quarter of the block cache, and the rest has to hold a
+// request's pins plus a frame to read into.
+#define MIN_BLOCK_CACHESIZE ((MAX_REQUEST_PINS + 1) * 4 / 3)
+#define MIN_INODE_CACHESIZE 1
+
+// how many names in directories the name cache remembers
+#define NAME_CACHESIZE 256
+
+// directories with this many entries get a hashed index
+#define DIR_INDEX_THRESHOLD 64
+#define DIR_ENTRIES_PER_BLOCK (BLOCKSIZE / (int)sizeof(struct dir_entry))
+#define INDEX_SLOTS_PER_BLOCK (BLOCKSIZE / (int)sizeof(unsigned short))
+
+// directories with at least this many entries are compacted once more than
+// COMPACT_FREE_PERCENT percent of them are free
+#define COMPACT_MIN_ENTRIES 32
+#define COMPACT_FREE_PERCENT 50
+
 typedef struct cacheItem cacheItem;
+typedef struct blockFrame blockFrame;
+typedef struct frameChunk frameChunk;
 typedef struct queue queue;
 
 struct cacheItem {
@@ -15,16 +50,33 @@ struct cacheItem {
     void *addr;
     cacheItem *prevItem;
     cacheItem *nextItem;
+    // which of its replacement policy's lists the item is on
+    int list;
+    // which block cache partition the item belongs to
+    int partition;
+    // a block with pins > 0 is never evicted; inodePins of those pins are
+    // held by inodes served in place, until the end of the current request
+    int pins;
+    int inodePins;
 };
 
-struct freeInode {
-    int inodeNumber;
-    freeInode *next;
+/*
+ * A block cache frame. Frames are allocated in slabs, one in init() and one
+ * each time the cache grows, so a cache miss or eviction never has to call
+ * malloc or free.
+ */
+struct blockFrame {
+    cacheItem item;
+    char data[BLOCKSIZE];
 };
 
-struct freeBlock {
-    int blockNumber;
-    freeBlock *next;
+/*
+ * One slab of block frames
+ */
+struct frameChunk {
+    blockFrame *frames;
+    int count;
+    frameChunk *next;
 };
 
 struct queue {
@@ -32,23 +84,103 @@ struct queue {
     cacheItem *lastItem;
 };
 
+/*
+ * A block cache partition, which evicts only its own blocks once it holds
+ * budget blocks
+ */
+struct cachePartition {
+    char *name;
+    int budget;
+    int size;
+    void *policyState;
+};
+
+/*
+ * Sequential read detection for one inode
+ */
+struct readahead {
+    int inodeNum;
+    // the byte offset where the last read of this inode ended
+    int nextOffset;
+    // how many blocks to keep read ahead of the reader, 0 if not sequential
+    int window;
+    // the first block of the file that has not been read ahead yet
+    int nextBlock;
+};
+
+/*
+ * Which blocks of a directory have free entries, so that a new entry can
+ * go straight to one of them
+ */
+struct dirFreeSlots {
+    // the directory, 0 if the slot is unused
+    int inodeNum;
+    // the directory's size when the summary was built or last updated; a
+    // directory of another size is summarized again
+    int size;
+    int numBlocks;
+    // the directory's blocks, and how many free entries each one has
+    int blocks[MAX_FILE_BLOCKS];
+    unsigned char freeEntries[MAX_FILE_BLOCKS];
+};
+
+/*
+ * What lookupPath() found for the last component of a path
+ */
+struct pathLookup {
+    // the directory the component is in, 0 if there is none
+    int dirInodeNum;
+    // the component, within the path; it ends at a '/' or a NUL
+    char *name;
+    // the inode of the directory's entry by that name, 0 if there is none
+    int inodeNum;
+    // where that entry is
+    int blockNum;
+    int offset;
+};
+
+cacheItem *removeItemFromFrontOfQueue(queue *queue);
+void removeItemFromQueue(queue *queue, cacheItem *item);
+void addItemToEndOfQueue(cacheItem *item, queue *queue);
+int parseServerOptions(int argc, char **argv);
 void *getBlock(int blockNumber);
+void *getMetadataBlock(int blockNumber);
+void *getBlockForOverwrite(int blockNumber);
+void *getMetadataBlockForOverwrite(int blockNumber);
+void prefetchBlock(int blockNumber);
 void destroyCacheItem(cacheItem *item);
+void printCacheStats(void);
+struct yfs_stats;
+int yfsStats(struct yfs_stats *statsbuf, int pid);
+int yfsResizeCaches(int blockCapacity, int inodeCapacity);
 struct inode* getInode(int inodeNum);
-void addFreeInodeToList(int inodeNum);
+void releaseInodePins(void);
+int foldInodeIntoBlock(int inodeNum, struct inode *inode);
+void markInodeFree(int inodeNum);
+void forgetFreeSlots(int dirInodeNum);
 void buildFreeInodeAndBlockLists();
+void writeBitmaps(void);
+void setCleanFlag(int clean);
 int getNextFreeBlockNum();
+int allocateBlockNear(int goal);
+int allocateNextBlock(int goal);
+void flushDelayedBlocks(void);
+void markBlockTaken(int blockNum);
+void markBlockFree(int blockNum);
+int lookupPath(char *pathname, int currentInode, bool followLast, struct pathLookup *lookup);
 int getDirectoryEntry(char *pathname, int inodeStartNumber, int *blockNumPtr, bool createIfNeeded);
 int yfsCreate(char *pathname, int currentInode, int inodeNumToSet);
 int yfsOpen(char *pathname, int currentInode);
 int yfsRead(int inodeNum, void *buf, int size, int byteOffset, int pid);
 int yfsWrite(int inodeNum, void *buf, int size, int byteOffset, int pid);
+int yfsFallocate(int inodeNum, int offset, int len);
 int yfsLink(char *oldName, char *newName, int currentInode);
 int yfsUnlink(char *pathname, int currentInode);
 int yfsSymLink(char *oldname, char *newname, int currentInode);
 int yfsReadLink(char *pathname, char *buf, int len, int currentInode, int pid);
 int yfsMkDir(char *pathname, int currentInode);
 int yfsRmDir(char *pathname, int currentInode);
+int yfsCompact(char *pathname, int currentInode);
 int yfsChDir(char *pathname, int currentInode);
 int yfsStat(char *pathname, int currentInode, struct Stat *statbuf, int pid);
 int yfsSync(void);